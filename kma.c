@@ -85,6 +85,20 @@ int freeCount = 0;
 //Variables used to record worst performance
 float worstFreeTime = 0;
 float worstMallocTime = 0;
+//Largest number of pages in use at any point of the trace
+int peakPages = 0;
+//Variables used to record realloc performance (REALLOC lines of a trace)
+float totReallocTime = 0;
+int reallocCount = 0;
+float worstReallocTime = 0;
+//Number of reallocs that kept their memory where it was
+int inPlaceCount = 0;
+//Frees go through kma_free_unsized if KMA_FREE_UNSIZED is set in the environment
+int unsizedFree = 0;
+//Number of allocations made with kma_memalign (MEMALIGN lines of a trace)
+int alignedCount = 0;
+//Number of allocations made with kma_calloc (CALLOC lines of a trace)
+int zeroedCount = 0;
 
 /************Global Variables*********************************************/
 
@@ -92,7 +106,9 @@ static int val = 0;
 
 /************Function Prototypes******************************************/
 void allocate();
+void* allocateCall();
 void deallocate();
+void reallocate();
 void fill(char*, int);
 void check(char*, char*, int);
 void usage();
@@ -148,6 +164,8 @@ main(int argc, char* argv[])
     {
       usage();
     }
+
+  unsizedFree = getenv("KMA_FREE_UNSIZED") != NULL;
   
   FILE* f_test = fopen(argv[1], "r");
   if (f_test == NULL)
@@ -165,7 +183,7 @@ main(int argc, char* argv[])
   memset(requests, 0, (n_req + 1)*sizeof(mem_t));
   
   char command[16];
-  int req_id, req_size, index = 1;
+  int req_id, req_size, req_align, req_count, index = 1;
 
   // Parse the lines in the file, and call allocate or
   // deallocate accordingly.
@@ -179,7 +197,31 @@ main(int argc, char* argv[])
 
 	  assert(req_id >= 0 && req_id < n_req);
 	  
-	  allocate(requests, req_id, req_size);
+	  allocate(requests, req_id, req_size, 0, 0);
+	  n_alloc++;
+	}
+      else if (strcmp(command, "MEMALIGN") == 0)
+	{
+	  if (fscanf(f_test, "%d %d %d", &req_id, &req_align, &req_size) != 3)
+	    error("Not enough arguments to MEMALIGN", "");
+
+	  assert(req_id >= 0 && req_id < n_req);
+	  assert(req_align > 0 && (req_align & (req_align - 1)) == 0);
+
+	  allocate(requests, req_id, req_size, req_align, 0);
+	  alignedCount++;
+	  n_alloc++;
+	}
+      else if (strcmp(command, "CALLOC") == 0)
+	{
+	  if (fscanf(f_test, "%d %d %d", &req_id, &req_count, &req_size) != 3)
+	    error("Not enough arguments to CALLOC", "");
+
+	  assert(req_id >= 0 && req_id < n_req);
+	  assert(req_count > 0);
+
+	  allocate(requests, req_id, req_count * req_size, 0, req_count);
+	  zeroedCount++;
 	  n_alloc++;
 	}
       else if (strcmp(command, "FREE") == 0)
@@ -192,6 +234,15 @@ main(int argc, char* argv[])
 	  deallocate(requests, req_id);
 	  n_dealloc++;
 	}
+      else if (strcmp(command, "REALLOC") == 0)
+	{
+	  if (fscanf(f_test, "%d %d", &req_id, &req_size) != 2)
+	    error("Not enough arguments to REALLOC", "");
+
+	  assert(req_id >= 0 && req_id < n_req);
+
+	  reallocate(requests, req_id, req_size);
+	}
       else
 	{
 	  error("unknown command type:", command);
@@ -199,6 +250,8 @@ main(int argc, char* argv[])
 
       stat = page_stats();
       int totalBytes = stat->num_in_use * stat->page_size;
+      if (stat->num_in_use > peakPages)
+        peakPages = stat->num_in_use;
 
       
 #ifdef COMPETITION
@@ -241,7 +294,27 @@ main(int argc, char* argv[])
   printf("Average milliseconds to malloc: %2f\t Average milliseconds to free: %2f\n", totMallocTime/mallocCount, totFreeTime/freeCount);
   printf("Worst milliseconds to malloc: %2f\t\t Worst milliseconds to free: %2f\n", worstMallocTime, worstFreeTime);
   printf("Average %% wasted (Wasted Bytes / Total Bytes): %f\n", ratioSum / ratioCount);
+  printf("Peak pages in use: %d\n", peakPages);
+  if (reallocCount > 0)
+    {
+      printf("Average milliseconds to realloc: %2f\t Worst milliseconds to realloc: %2f\n", totReallocTime/reallocCount, worstReallocTime);
+    }
   #endif
+
+  if (reallocCount > 0)
+    {
+      printf("Reallocs in place: %d/%d\n", inPlaceCount, reallocCount);
+    }
+
+  if (alignedCount > 0)
+    {
+      printf("Aligned allocations: %d\n", alignedCount);
+    }
+
+  if (zeroedCount > 0)
+    {
+      printf("Zeroed allocations: %d\n", zeroedCount);
+    }
   
   printf("Page Requested/Freed/In Use: %5d/%5d/%5d\n",
 	 stat->num_requested, stat->num_freed, stat->num_in_use);
@@ -290,8 +363,26 @@ error(char* message, char* arg ) {
   fail();
 }
 
+// allocates with kma_malloc, with kma_memalign if an alignment is given, or
+// with kma_calloc if a count is given (req_size is then the total size)
+void*
+allocateCall(int req_size, int req_align, int req_count)
+{
+  if (req_align > 0)
+    {
+      return kma_memalign(req_align, req_size);
+    }
+
+  if (req_count > 0)
+    {
+      return kma_calloc(req_count, req_size / req_count);
+    }
+
+  return kma_malloc(req_size);
+}
+
 void
-allocate(mem_t* requests, int req_id, int req_size)
+allocate(mem_t* requests, int req_id, int req_size, int req_align, int req_count)
 {
   mem_t* new = &requests[req_id];
   
@@ -301,7 +392,7 @@ allocate(mem_t* requests, int req_id, int req_size)
 
   #ifndef COMPETITION
     clock_t begin = clock();
-    new->ptr = kma_malloc(new->size);
+    new->ptr = allocateCall(new->size, req_align, req_count);
     clock_t end = clock();
     float mallocTime = ((double)(end - begin) / CLOCKS_PER_SEC)*1000;
     worstMallocTime = worstMallocTime > mallocTime ? worstMallocTime : mallocTime;
@@ -310,12 +401,14 @@ allocate(mem_t* requests, int req_id, int req_size)
   #endif
 
   #ifdef COMPETITION
-    new->ptr = kma_malloc(new->size);
+    new->ptr = allocateCall(new->size, req_align, req_count);
   #endif
   
   // Accept a NULL response in some cases... 
-  if(!(((new->ptr != NULL) && (new->size <= (PAGESIZE - sizeof(void*))))
-       || ((new->ptr == NULL) && (new->size > (PAGESIZE - sizeof(void*))))))
+  // (an aligned request has to fit in a page after its alignment)
+  int limit = (req_align > 0) ? PAGESIZE - req_align : PAGESIZE - sizeof(void*);
+  if(!(((new->ptr != NULL) && (new->size <= limit))
+       || ((new->ptr == NULL) && (new->size > limit))))
     {
       error("got NULL from kma_malloc for alloc'able request", "");
     }
@@ -325,6 +418,11 @@ allocate(mem_t* requests, int req_id, int req_size)
       return;
     }
 
+  if (req_align > 0 && (long)new->ptr % req_align != 0)
+    {
+      error("got a misaligned address from kma_memalign", "");
+    }
+
   currentAllocBytes += req_size;
   
 #ifndef COMPETITION
@@ -334,6 +432,25 @@ allocate(mem_t* requests, int req_id, int req_size)
   new->value = malloc(new->size);
   assert(new->value != NULL);
   
+  if (kma_usable_size(new->ptr) < new->size)
+    {
+      error("got a usable size below the request from kma_usable_size", "");
+    }
+  
+  // memory from kma_calloc has to come zeroed
+  if (req_count > 0)
+    {
+      int i;
+
+      for (i = 0; i < new->size; i++)
+	{
+	  if (((char*)new->ptr)[i] != 0)
+	    {
+	      error("got nonzero memory from kma_calloc", "");
+	    }
+	}
+    }
+  
   // initialize memory
   fill((char*)new->ptr, new->size);
   
@@ -362,8 +479,17 @@ deallocate(mem_t* requests, int req_id)
   check((char*)cur->ptr, (char*)cur->value, cur->size);
 
   // free memory
-  clock_t begin = clock();
   free(cur->value);
+
+  clock_t begin = clock();
+  if (unsizedFree)
+    {
+      kma_free_unsized(cur->ptr);
+    }
+  else
+    {
+      kma_free(cur->ptr, cur->size);
+    }
   clock_t end = clock();
   float freeTime = ((double)(end - begin) / CLOCKS_PER_SEC)*1000;
   worstFreeTime = worstFreeTime > freeTime ? worstFreeTime : freeTime;
@@ -371,13 +497,88 @@ deallocate(mem_t* requests, int req_id)
   freeCount++;
 #endif
 
-  kma_free(cur->ptr, cur->size);
+#ifdef COMPETITION
+  if (unsizedFree)
+    {
+      kma_free_unsized(cur->ptr);
+    }
+  else
+    {
+      kma_free(cur->ptr, cur->size);
+    }
+#endif
 
   currentAllocBytes -= cur->size;
   
   cur->state = FREE;
 }
 
+void
+reallocate(mem_t* requests, int req_id, int req_size)
+{
+  mem_t* cur = &requests[req_id];
+  int old_size = cur->size;
+  void* ptr;
+  
+  assert(cur->state == USED);
+  
+#ifndef COMPETITION
+  check((char*)cur->ptr, (char*)cur->value, cur->size);
+
+  clock_t begin = clock();
+  ptr = kma_realloc(cur->ptr, cur->size, req_size);
+  clock_t end = clock();
+  float reallocTime = ((double)(end - begin) / CLOCKS_PER_SEC)*1000;
+  worstReallocTime = worstReallocTime > reallocTime ? worstReallocTime : reallocTime;
+  totReallocTime = totReallocTime + reallocTime;
+#endif
+
+#ifdef COMPETITION
+  ptr = kma_realloc(cur->ptr, cur->size, req_size);
+#endif
+
+  reallocCount++;
+
+  // NULL leaves the old memory as it was, which is only fine if the new
+  // size is too large
+  if (ptr == NULL)
+    {
+      if (req_size <= (PAGESIZE - sizeof(void*)))
+	{
+	  error("got NULL from kma_realloc for alloc'able request", "");
+	}
+      return;
+    }
+
+  if (ptr == cur->ptr)
+    {
+      inPlaceCount++;
+    }
+
+  cur->ptr = ptr;
+  cur->size = req_size;
+  currentAllocBytes += req_size - old_size;
+
+#ifndef COMPETITION
+  // the contents up to the smaller size must have come along, fill the rest
+  check((char*)cur->ptr, (char*)cur->value, old_size < req_size ? old_size : req_size);
+
+  if (kma_usable_size(cur->ptr) < req_size)
+    {
+      error("got a usable size below the request from kma_usable_size", "");
+    }
+
+  cur->value = realloc(cur->value, req_size);
+  assert(cur->value != NULL);
+
+  if (req_size > old_size)
+    {
+      fill((char*)cur->ptr + old_size, req_size - old_size);
+    }
+  bcopy(cur->ptr, cur->value, req_size);
+#endif
+}
+
 void
 fill(char* ptr, int size)
 {
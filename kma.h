@@ -65,6 +65,33 @@
 
 typedef int kma_size_t;
 
+// with the magazine layer in front (KMA_MAGAZINE), the allocator compiled in
+// becomes its backend and the kma_ entry points are served by kma_magazine.c
+#if defined(KMA_MAGAZINE) && defined(__KMA_IMPL__)
+#define kma_malloc kma_backend_malloc
+#define kma_free kma_backend_free
+#define kma_realloc kma_backend_realloc
+#define kma_memalign kma_backend_memalign
+#define kma_calloc kma_backend_calloc
+#define kma_free_unsized kma_backend_free_unsized
+#define kma_usable_size kma_backend_usable_size
+#endif
+
+// the meta-allocator (KMA_META) links several allocators into one program. Each
+// of them names its kma_ entry points after KMA_BACKEND (kma_rm_malloc,
+// kma_rm_free, ...) and kma_meta.c serves the real ones
+#if defined(KMA_META) && defined(__KMA_IMPL__) && defined(KMA_BACKEND)
+#define KMA_BACKEND_FN(backend, fn) KMA_BACKEND_NAME(backend, fn)
+#define KMA_BACKEND_NAME(backend, fn) kma_##backend##_##fn
+#define kma_malloc KMA_BACKEND_FN(KMA_BACKEND, malloc)
+#define kma_free KMA_BACKEND_FN(KMA_BACKEND, free)
+#define kma_realloc KMA_BACKEND_FN(KMA_BACKEND, realloc)
+#define kma_memalign KMA_BACKEND_FN(KMA_BACKEND, memalign)
+#define kma_calloc KMA_BACKEND_FN(KMA_BACKEND, calloc)
+#define kma_free_unsized KMA_BACKEND_FN(KMA_BACKEND, free_unsized)
+#define kma_usable_size KMA_BACKEND_FN(KMA_BACKEND, usable_size)
+#endif
+
 /************Global Variables*********************************************/
 
 /************Function Prototypes******************************************/
@@ -91,6 +118,76 @@ EXTERN void* kma_malloc(kma_size_t size);
  ***********************************************************************/
 EXTERN void kma_free(void*, kma_size_t size);
 
+/***********************************************************************
+ *  Title: Frees kernel memory of unknown size
+ * ---------------------------------------------------------------------
+ *    Purpose: Frees the memory space pointed to by ptr like kma_free()
+ *             for callers that don't keep the size. The allocator
+ *             finds it from the metadata of the page ptr is on
+ *             (BASEADDR(ptr)), there is no header in front of the
+ *             memory for it
+ *    Input: the pointer to the memory space
+ *    Output: none
+ ***********************************************************************/
+EXTERN void kma_free_unsized(void* ptr);
+
+/***********************************************************************
+ *  Title: Finds the usable size of kernel memory
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns how many bytes of the memory space pointed to
+ *             by ptr can be used, at least the size it was allocated
+ *             with. The allocator finds it from the metadata of the
+ *             page ptr is on like kma_free_unsized(). It only reads
+ *             metadata that doesn't change while the memory is in
+ *             use, so it can be called without the lock a layer in
+ *             front of the allocator takes around the other calls
+ *    Input: the pointer to the memory space
+ *    Output: the usable size
+ ***********************************************************************/
+EXTERN kma_size_t kma_usable_size(void* ptr);
+
+/***********************************************************************
+ *  Title: Resizes kernel memory
+ * ---------------------------------------------------------------------
+ *    Purpose: Changes the size of the memory space pointed to by ptr,
+ *             which must have been returned by a previous call to
+ *             kma_malloc() or kma_realloc(). The memory is grown or
+ *             shrunk where it is if the allocator can, otherwise it
+ *             is moved. The contents up to the smaller of both sizes
+ *             are kept
+ *    Input: the pointer to the memory space, its current size, the
+ *           new size
+ *    Output: the memory space, which may have moved, or NULL on
+ *            failure (the old memory space is then left as it was)
+ ***********************************************************************/
+EXTERN void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size);
+
+/***********************************************************************
+ *  Title: Allocates aligned kernel memory
+ * ---------------------------------------------------------------------
+ *    Purpose: Allocates size bytes at an address that is a multiple
+ *             of alignment. The memory is freed with kma_free() and
+ *             the same size. kma_realloc() keeps the alignment only
+ *             if it doesn't move the memory
+ *    Input: the alignment (a power of 2), the size
+ *    Output: the allocated memory or NULL on failure, which includes
+ *            an alignment the allocator can't give memory of this
+ *            size
+ ***********************************************************************/
+EXTERN void* kma_memalign(kma_size_t alignment, kma_size_t size);
+
+/***********************************************************************
+ *  Title: Allocates zeroed kernel memory
+ * ---------------------------------------------------------------------
+ *    Purpose: Allocates count * size bytes set to zero. The memory
+ *             is freed with kma_free() and count * size. Memory the
+ *             allocator knows is still zero (from a page get_page()
+ *             returned zeroed) isn't cleared again
+ *    Input: the number of elements, the size of an element
+ *    Output: the allocated memory or NULL on failure
+ ***********************************************************************/
+EXTERN void* kma_calloc(kma_size_t count, kma_size_t size);
+
 /************External Declaration*****************************************/
 
 /**************Definition***************************************************/
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *  Title: Kernel Memory Arenas
+ * -------------------------------------------------------------------------
+ *    Purpose: Region arenas with bump pointer allocation and bulk free,
+ *             built on the page allocator
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+#define __KARENA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+#include "kma_arena.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// alignment of everything handed out
+#define ARENA_ALIGN 8
+
+typedef struct kma_arena_page kma_arena_page_t;
+
+// at the start of every page of an arena
+struct kma_arena_page
+{
+  kma_page_t*        page; // the page object to hand back to free_page
+  kma_arena_page_t*  next; // the page taken before this one, NULL for the first page
+};
+
+// lives in the first page of the arena, right after its page header
+struct kma_arena
+{
+  kma_arena_page_t*  pages; // the page allocations come from, the others follow it
+  char*              top;   // next free byte of that page
+  char*              end;   // end of that page
+};
+
+// rounds x up to a multiple of a (a power of 2)
+#define ROUND_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+// where allocations start in the first page and in every other page
+#define FIRST_OFFSET ROUND_UP(sizeof(kma_arena_page_t) + sizeof(kma_arena_t), ARENA_ALIGN)
+#define PAGE_OFFSET ROUND_UP(sizeof(kma_arena_page_t), ARENA_ALIGN)
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+kma_arena_page_t* arena_page();
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+// takes a page and puts its header in front
+kma_arena_page_t*
+arena_page()
+{
+  kma_page_t* page = get_page();
+  kma_arena_page_t* ap = page->ptr;
+
+  ap->page = page;
+  ap->next = NULL;
+
+  return ap;
+}
+
+kma_arena_t*
+kma_arena_create()
+{
+  kma_arena_page_t* first = arena_page();
+  kma_arena_t* arena = (kma_arena_t*)(first + 1);
+
+  arena->pages = first;
+  arena->top = (char*)first + FIRST_OFFSET;
+  arena->end = (char*)first + PAGESIZE;
+
+  return arena;
+}
+
+void*
+kma_arena_alloc(kma_arena_t* arena, kma_size_t size)
+{
+  size = size <= 0 ? ARENA_ALIGN : ROUND_UP(size, ARENA_ALIGN);
+
+  if (size > arena->end - arena->top)
+    {
+      // the rest of the current page is given up
+      if (size > PAGESIZE - PAGE_OFFSET)
+        {
+          return NULL;
+        }
+
+      kma_arena_page_t* ap = arena_page();
+
+      ap->next = arena->pages;
+      arena->pages = ap;
+      arena->top = (char*)ap + PAGE_OFFSET;
+      arena->end = (char*)ap + PAGESIZE;
+    }
+
+  void* ptr = arena->top;
+  arena->top += size;
+
+  return ptr;
+}
+
+void
+kma_arena_reset(kma_arena_t* arena)
+{
+  kma_arena_page_t* ap = arena->pages;
+
+  // everything but the first page, which holds the arena
+  while (ap->next != NULL)
+    {
+      kma_arena_page_t* next = ap->next;
+
+      free_page(ap->page);
+      ap = next;
+    }
+
+  arena->pages = ap;
+  arena->top = (char*)ap + FIRST_OFFSET;
+  arena->end = (char*)ap + PAGESIZE;
+}
+
+void
+kma_arena_destroy(kma_arena_t* arena)
+{
+  kma_arena_reset(arena);
+
+  free_page(arena->pages->page);
+}
@@ -0,0 +1,89 @@
+/***************************************************************************
+ *  Title: Kernel Memory Arenas
+ * -------------------------------------------------------------------------
+ *    Purpose: Interface for the region arenas
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+
+#ifndef __KARENA_H__
+#define __KARENA_H__
+
+/************System include***********************************************/
+
+/************Private include**********************************************/
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __KARENA_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+typedef struct kma_arena kma_arena_t;
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Creates an arena
+ * ---------------------------------------------------------------------
+ *    Purpose: Creates an empty arena. Its memory comes from pages from
+ *             get_page(), the first of which also holds the arena
+ *    Input: none
+ *    Output: the arena
+ ***********************************************************************/
+EXTERN kma_arena_t* kma_arena_create();
+
+/***********************************************************************
+ *  Title: Allocates from an arena
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns size bytes (8 byte aligned) from the arena by
+ *             bumping a pointer. There is no way to free them one by
+ *             one, they all go with kma_arena_reset or kma_arena_destroy
+ *    Input: the arena, the size
+ *    Output: the memory or NULL if size doesn't fit in a page
+ ***********************************************************************/
+EXTERN void* kma_arena_alloc(kma_arena_t* arena, kma_size_t size);
+
+/***********************************************************************
+ *  Title: Resets an arena
+ * ---------------------------------------------------------------------
+ *    Purpose: Frees everything allocated from the arena at once. All
+ *             of its pages but the first are given back
+ *    Input: the arena
+ *    Output: none
+ ***********************************************************************/
+EXTERN void kma_arena_reset(kma_arena_t* arena);
+
+/***********************************************************************
+ *  Title: Destroys an arena
+ * ---------------------------------------------------------------------
+ *    Purpose: Frees everything allocated from the arena and the arena
+ *             itself, all of its pages are given back
+ *    Input: the arena
+ *    Output: none
+ ***********************************************************************/
+EXTERN void kma_arena_destroy(kma_arena_t* arena);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __KARENA_H__ */
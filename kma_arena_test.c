@@ -0,0 +1,126 @@
+/***************************************************************************
+ *  Title: Kernel Memory Arenas
+ * -------------------------------------------------------------------------
+ *    Purpose: Checks contents, alignment, the size limit and page
+ *             accounting of the region arenas
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+
+/************System include***********************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+#include "kma_arena.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// objects allocated before each reset, and the number of resets
+#define OBJS 5000
+#define ROUNDS 4
+
+// largest object an arena can hand out, a page less its 16 byte header
+#define ARENA_MAX (PAGESIZE - 16)
+
+/************Global Variables*********************************************/
+
+static int gFailures = 0;
+
+/************Function Prototypes******************************************/
+void check(int, char*);
+int pages_in_use();
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+int
+main(int argc, char* argv[])
+{
+  static char* objs[OBJS];
+  static int sizes[OBJS];
+  unsigned int seed = 1;
+  int round, i, j;
+
+  kma_arena_t* arena = kma_arena_create();
+  check(arena != NULL, "arena created");
+  check(pages_in_use() == 1, "a new arena holds one page");
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      // every object is 8 byte aligned and keeps what was written to it
+      // until the reset, so no two objects overlap
+      for (i = 0; i < OBJS; i++)
+        {
+          sizes[i] = rand_r(&seed) % 301;
+          objs[i] = kma_arena_alloc(arena, sizes[i]);
+          check(objs[i] != NULL, "object allocated");
+          check((long)objs[i] % 8 == 0, "object 8 byte aligned");
+          check(BASEADDR(objs[i]) == BASEADDR(objs[i] + (sizes[i] > 0 ? sizes[i] - 1 : 0)),
+                "object within one page");
+          memset(objs[i], (char)(i + round), sizes[i]);
+        }
+      for (i = 0; i < OBJS; i++)
+        {
+          for (j = 0; j < sizes[i]; j++)
+            {
+              if (objs[i][j] != (char)(i + round))
+                {
+                  break;
+                }
+            }
+          check(j == sizes[i], "object contents kept");
+        }
+      check(pages_in_use() > 1, "objects spread over several pages");
+
+      kma_arena_reset(arena);
+      check(pages_in_use() == 1, "reset gives back every page but the first");
+    }
+
+  // the largest object takes a page of its own, anything larger gets NULL
+  char* big = kma_arena_alloc(arena, ARENA_MAX);
+  check(big != NULL, "largest object allocated");
+  check(big == (char*)BASEADDR(big) + PAGESIZE - ARENA_MAX, "largest object fills its page");
+  memset(big, 1, ARENA_MAX);
+  check(kma_arena_alloc(arena, ARENA_MAX + 1) == NULL, "object larger than a page refused");
+  check(pages_in_use() == 2, "refused object takes no page");
+
+  kma_arena_destroy(arena);
+  check(pages_in_use() == 0, "destroy gives back every page");
+
+  printf("Test: %s\n", gFailures == 0 ? "PASS" : "FAIL");
+
+  return gFailures == 0 ? 0 : 1;
+}
+
+int
+pages_in_use()
+{
+  return page_stats()->num_in_use;
+}
+
+void
+check(int ok, char* what)
+{
+  if (!ok)
+    {
+      fprintf(stderr, "FAILED: %s\n", what);
+      gFailures++;
+    }
+}
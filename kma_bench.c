@@ -0,0 +1,319 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Multi-threaded scaling benchmark for the thread safe kernel
+ *             memory allocators
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// most threads a run can use
+#define MAX_THREADS 64
+
+// number of malloc/free pairs of a run, split over the threads
+#define PAIRS 2000000
+
+// threadtest: objects a thread allocates before it frees them all
+#define BATCH 100
+
+// larson: objects shared by all threads, every op replaces a random one
+#define SLOTS 4096
+
+// active-false: writes to every object before it is freed
+#define WRITES 100
+
+typedef struct
+{
+  char* name;
+  void* (*run)(void*);
+  int pairs;       // malloc/free pairs of a run
+  char* description;
+} workload_t;
+
+typedef struct
+{
+  int id;
+  int ops;
+  int peak_pages;  // largest number of pages in use this thread saw
+} worker_t;
+
+/************Global Variables*********************************************/
+
+// larson: the shared objects and their sizes
+static void* gSlots[SLOTS];
+static int gSlotSize[SLOTS];
+static pthread_mutex_t gSlotLocks[SLOTS];
+
+// largest number of pages in use seen by any thread of the last run
+static int gPeakPages = 0;
+
+/************Function Prototypes******************************************/
+void* threadtest(void*);
+void* larson(void*);
+void* active_false(void*);
+void note_pages(worker_t*);
+double run_workload(workload_t*, int);
+void usage();
+void error(char*, char*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+static workload_t kWorkloads[] = {
+  { "threadtest",   threadtest,   PAIRS,          "each thread allocates and frees its own batches" },
+  { "larson",       larson,       PAIRS,          "threads replace shared objects, most frees are remote" },
+  { "active-false", active_false, PAIRS / WRITES, "small objects written hard by their thread (false sharing)" },
+};
+
+char *name = NULL;
+
+int
+main(int argc, char* argv[])
+{
+  int max_threads = 8;
+  int i, threads;
+
+  name = argv[0];
+
+  if (argc > 2)
+    {
+      usage();
+    }
+  if (argc == 2)
+    {
+      max_threads = atoi(argv[1]);
+      if (max_threads < 1 || max_threads > MAX_THREADS)
+        {
+          usage();
+        }
+    }
+
+  for (i = 0; i < SLOTS; i++)
+    {
+      pthread_mutex_init(&gSlotLocks[i], NULL);
+    }
+
+  for (i = 0; i < sizeof(kWorkloads) / sizeof(kWorkloads[0]); i++)
+    {
+      workload_t* w = &kWorkloads[i];
+      double base = 0;
+
+      printf("%s: %s\n", w->name, w->description);
+      fflush(stdout);
+      printf("  threads   seconds   Mpairs/s   speedup   peak pages\n");
+
+      for (threads = 1; threads <= max_threads; threads *= 2)
+        {
+          gPeakPages = 0;
+
+          double seconds = run_workload(w, threads);
+          if (threads == 1)
+            {
+              base = seconds;
+            }
+
+          printf("  %7d   %7.3f   %8.3f   %7.2f   %10d\n", threads, seconds,
+                 w->pairs / seconds / 1e6, base / seconds, gPeakPages);
+          fflush(stdout);
+
+          if (page_stats()->num_in_use != 0)
+            {
+              error("not all pages freed after", w->name);
+            }
+        }
+    }
+
+  return 0;
+}
+
+// runs a workload on the given number of threads, returns the wall clock time
+double
+run_workload(workload_t* w, int threads)
+{
+  pthread_t ids[MAX_THREADS];
+  worker_t workers[MAX_THREADS];
+  struct timespec start, end;
+  int i;
+
+  // the page pool is set up again every time no page is in use, which would
+  // cost more than the allocations themselves. Hold one page for the run
+  kma_page_t* pin = get_page();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (i = 0; i < threads; i++)
+    {
+      workers[i].id = i;
+      workers[i].ops = w->pairs / threads;
+      workers[i].peak_pages = 0;
+      pthread_create(&ids[i], NULL, w->run, &workers[i]);
+    }
+  for (i = 0; i < threads; i++)
+    {
+      pthread_join(ids[i], NULL);
+      if (workers[i].peak_pages > gPeakPages)
+        {
+          gPeakPages = workers[i].peak_pages;
+        }
+    }
+
+  // larson leaves its shared objects allocated
+  for (i = 0; i < SLOTS; i++)
+    {
+      if (gSlots[i] != NULL)
+        {
+          kma_free(gSlots[i], gSlotSize[i]);
+          gSlots[i] = NULL;
+        }
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  free_page(pin);
+
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// keeps track of the peak number of pages in use a thread sees (sampled, not
+// exact), the peaks of the threads are combined once they are joined
+void
+note_pages(worker_t* worker)
+{
+  int pages = page_stats()->num_in_use;
+
+  if (pages > worker->peak_pages)
+    {
+      worker->peak_pages = pages;
+    }
+}
+
+void*
+threadtest(void* arg)
+{
+  worker_t* worker = arg;
+  unsigned int seed = worker->id + 1;
+  void* objs[BATCH];
+  int sizes[BATCH];
+  int done, i;
+
+  for (done = 0; done < worker->ops; done += BATCH)
+    {
+      for (i = 0; i < BATCH; i++)
+        {
+          sizes[i] = 16 + rand_r(&seed) % 241;
+          objs[i] = kma_malloc(sizes[i]);
+          *(int*)objs[i] = i;
+        }
+
+      note_pages(worker);
+
+      for (i = 0; i < BATCH; i++)
+        {
+          assert(*(int*)objs[i] == i);
+          kma_free(objs[i], sizes[i]);
+        }
+    }
+
+  return NULL;
+}
+
+void*
+larson(void* arg)
+{
+  worker_t* worker = arg;
+  unsigned int seed = worker->id + 1;
+  int done;
+
+  for (done = 0; done < worker->ops; done++)
+    {
+      int slot = rand_r(&seed) % SLOTS;
+      int size = 16 + rand_r(&seed) % 497;
+      void* obj = kma_malloc(size);
+
+      memset(obj, 0, size < 64 ? size : 64);
+
+      // the old object was most likely allocated by another thread
+      pthread_mutex_lock(&gSlotLocks[slot]);
+      void* old = gSlots[slot];
+      int old_size = gSlotSize[slot];
+      gSlots[slot] = obj;
+      gSlotSize[slot] = size;
+      pthread_mutex_unlock(&gSlotLocks[slot]);
+
+      if (old != NULL)
+        {
+          kma_free(old, old_size);
+        }
+
+      if (done % 1024 == 0)
+        {
+          note_pages(worker);
+        }
+    }
+
+  return NULL;
+}
+
+void*
+active_false(void* arg)
+{
+  worker_t* worker = arg;
+  int done, i;
+
+  for (done = 0; done < worker->ops; done++)
+    {
+      volatile char* obj = kma_malloc(8);
+
+      note_pages(worker);
+
+      for (i = 0; i < WRITES; i++)
+        {
+          obj[0]++;
+        }
+
+      kma_free((void*)obj, 8);
+    }
+
+  return NULL;
+}
+
+void
+usage()
+{
+  printf("Usage: %s [max threads (1..%d)]\n", name, MAX_THREADS);
+  exit(0);
+}
+
+void
+error(char* message, char* arg)
+{
+  fprintf(stderr, "ERROR: %s: %s.\n", message, arg);
+  exit(1);
+}
@@ -33,10 +33,13 @@
  ***************************************************************************/
 #ifdef KMA_BUD
 #define __KMA_IMPL__
+//name of this allocator's kma_ entry points when it is linked into the meta-allocator (KMA_META)
+#define KMA_BACKEND bud
 
 /************System include***********************************************/
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 /************Private include**********************************************/
@@ -51,67 +54,138 @@
  */
 
 //Holds the very first page that points to everything else
-kma_page_t* firstPageListPage = NULL;
-
-typedef struct pageListNode
+kma_page_t* rootPage = NULL;
+
+//Smallest buddy block (requests below it go to the slab front-end)
+#define MIN_BLOCK_SIZE 512
+//Number of buddy block orders (512 bytes up to 8192 bytes)
+#define BUDDY_ORDERS 5
+//Returns the buddy order of a power of 2 buffer size (512 is order 0)
+#define SIZE_ORDER(size) (__builtin_ctz(size) - 9)
+
+//Number of data pages described by one page table page. A page table page describes an
+//aligned group of page numbers, so the slot of a data page comes straight from its address
+#define PAGE_TABLE_SLOTS 128
+//Depth of the data page nodes in a page table tree (log2 of PAGE_TABLE_SLOTS)
+#define PAGE_LEVEL 7
+//Depth of the smallest blocks in a page table tree
+#define BLOCK_LEVEL (PAGE_LEVEL + BUDDY_ORDERS - 1)
+//Number of entries of a page table tree (1 based, entry 0 is unused)
+#define TREE_SIZE (2 << BLOCK_LEVEL)
+
+//Number of page table pages the root page can point to, a power of 2 larger than the
+//number of groups the page pool can touch, so the groups in use never share an entry
+#define DIRECTORY_SIZE 64
+
+//Returns the page number of an address
+#define PAGE_NUMBER(addr) ((long)(addr) / PAGESIZE)
+//Returns the directory entry of the page table page that describes a page number
+#define DIRECTORY_INDEX(pageNumber) (((pageNumber) / PAGE_TABLE_SLOTS) % DIRECTORY_SIZE)
+
+//Returns the page table page that describes the page of an address
+#define TABLE_OF(addr) (ROOT->directory[DIRECTORY_INDEX(PAGE_NUMBER(addr))])
+//Returns the tree node of the block of an order that starts at an address
+#define BLOCK_NODE(addr, order) ((1 << (BLOCK_LEVEL - (order))) + ((PAGE_NUMBER(addr) % PAGE_TABLE_SLOTS) << (BUDDY_ORDERS - 1 - (order))) + ((void*)(addr) - BASEADDR(addr)) / (MIN_BLOCK_SIZE << (order)))
+
+//Returns the depth of node i of a tree (the root is node 1 at depth 0)
+#define NODE_LEVEL(i) (31 - __builtin_clz(i))
+
+//Returns the root page's contents
+#define ROOT ((rootTable*)rootPage->ptr)
+
+//Metadata of the data pages in one group of PAGE_TABLE_SLOTS page numbers. tree is a complete
+//binary tree stored as an implicit array (the children of node i are 2i and 2i+1). The nodes at
+//PAGE_LEVEL are the data pages, the nodes below them the buddy blocks of a page, down to 512
+//bytes at BLOCK_LEVEL. Each node holds 1 + the largest free order under it, or 0 if nothing
+//is free (or, for a page node, if the slot holds no data page)
+typedef struct pageTable
 {
-	char bitMap[64]; //Bit map to track allocated vs free data in data pages (64 bytes = 512bits, 512*16 = 8192)
-	struct pageListNode* nextNode; //Pointer to next page List Node
-	kma_page_t* dataPage; //Pointer to page object that points to a data page
-	kma_page_t*  myPage; //Pointer to page object that points to the page this node is stored on
-} pageListNode;
-
-typedef struct freeListNode
+	unsigned char tree[TREE_SIZE];
+	kma_page_t* dataPage[PAGE_TABLE_SLOTS]; //Page objects of the data pages (NULL for unused slots)
+	unsigned short usedBlocks[PAGE_TABLE_SLOTS]; //Bit i is set once 512 byte block i of the data page
+	                                            //was handed out, every bit if the page didn't come zeroed
+	long group; //Page number of slot 0 divided by PAGE_TABLE_SLOTS
+	int usedSlots; //Number of slots that hold a data page
+	kma_page_t* myPage; //Pointer to page object that points to this table page
+} pageTable;
+
+//Lives in the root page. tree is built the same way over the directory entries, each leaf
+//holding the root of that page table page's tree
+typedef struct rootTable
 {
-	void* buffLocation;
-	kma_size_t buffSize;
-	struct freeListNode* nextNode;
-	kma_page_t*  myPage; //Pointer to the page object that points to this node's page
-} freeListNode;
-
-//Returns pointer to the first free list page kma_page_t object
-#define FIRST_FREE_LIST_PAGE (*(kma_page_t**)firstPageListPage->ptr)
+	unsigned char tree[2*DIRECTORY_SIZE];
+	pageTable* directory[DIRECTORY_SIZE];
+	int dataPageCount; //Number of data pages in use
+} rootTable;
+
+//Requests smaller than this are served by the slab front-end instead of buddy blocks
+#define SLAB_MAX_SIZE 512
+//Number of slab size classes (16 byte steps to 128, 32 byte steps to 256, 64 byte steps to 512)
+#define SLAB_CLASS_COUNT 16
+//Returns the slab size class index of a request smaller than SLAB_MAX_SIZE
+#define SLAB_CLASS(size) (kSlabClassOf[((size) - 1) >> 4])
+//Size of the buddy block backing one slab
+#define SLAB_SIZE 2048
+//Buddy order of the block backing one slab
+#define SLAB_ORDER SIZE_ORDER(SLAB_SIZE)
+//The nodes under an allocated block aren't looked at until it is freed, so the left child of a
+//slab's block holds this instead to tell it from a buddy block of the same order
+#define SLAB_MARK 0xFF
+//Returns the slab header at the end of the slab that holds ptr (buddy blocks are aligned to their size)
+#define SLAB_HEADER(ptr) ((slabHeader*)((((long)(ptr)) & ~(SLAB_SIZE-1)) + SLAB_SIZE - sizeof(slabHeader)))
+//Returns the start of the slab of a slab header
+#define SLAB_START(slab) ((void*)(slab) + sizeof(slabHeader) - SLAB_SIZE)
+
+//Sits at the end of every buddy block handed to the slab front-end. The rest of the block
+//is cut into objects of a single size class from the start, so every object is aligned to
+//the largest power of 2 that divides its size
+typedef struct slabHeader
+{
+	struct slabHeader* nextSlab; //Next slab of the same class that still has free objects
+	struct slabHeader* prevSlab; //Previous slab of the same class that still has free objects
+	void* freeObjList; //Recycled objects of this slab
+	short carveOffset; //Offset of the next never used object (bump pointer)
+	unsigned char sizeClass; //Index into kSlabClassSize
+	unsigned char zero; //The block was never handed out before, so objects not carved yet are zero
+	short objCount; //Number of objects that fit on the slab
+	short freeCount; //Objects not handed out (recycled or not yet carved)
+} slabHeader;
 
-//Returns pointer to the first node in the filled page list
-#define FILLED_PAGE_NODE_LIST (*(pageListNode**)((void*)firstPageListPage->ptr + sizeof(int*)))
-//Returns pointer to the first node in the empty page node list
-#define EMPTY_PAGE_NODE_LIST (*(pageListNode**)((void*)firstPageListPage->ptr + sizeof(int*)*2))
+/************Global Variables*********************************************/
 
-//Returns pointer to the first node in the empty free node list
-#define EMPTY_FREE_NODE_LIST (*(freeListNode**)((*(kma_page_t**)firstPageListPage->ptr)->ptr + sizeof(int*)*10))
-//Returns pointer to the first node in the free node list of buffSize size
-#define FILLED_FREE_NODE_LIST(size) (*(freeListNode**)((*(kma_page_t**)firstPageListPage->ptr)->ptr + ((int)floor(log((double)size)/log(2.0)) - 4)*sizeof(int*)))
+//Object size of each slab size class
+static const short kSlabClassSize[SLAB_CLASS_COUNT] =
+	{  16,  32,  48,  64,  80,  96, 112, 128,
+	  160, 192, 224, 256, 320, 384, 448, 512 };
 
-//Returns node count int of the page you passed in
-#define NODE_COUNT(page) (*(int*)((void*)page->ptr + page->size - sizeof(int)))
+//Slab size class of each 16 byte step below SLAB_MAX_SIZE
+static const char kSlabClassOf[SLAB_MAX_SIZE/16] =
+	{   0,   1,   2,   3,   4,   5,   6,   7,
+	    8,   8,   9,   9,  10,  10,  11,  11,
+	   12,  12,  12,  12,  13,  13,  13,  13,
+	   14,  14,  14,  14,  15,  15,  15,  15 };
 
-//Returns smaller of two addresses
-#define MIN_ADDR(x,y) ((x) < (y) ? (x) : (y))
-
-/************Global Variables*********************************************/
+//Head of the list of slabs with free objects for every size class
+slabHeader* gSlabPartialList[SLAB_CLASS_COUNT];
 
 /************Function Prototypes******************************************/
 
+void* buddyMalloc(kma_size_t size, bool* zero);
+void buddyFree(void* ptr, kma_size_t size);
+bool buddyResize(void* ptr, kma_size_t oldSize, kma_size_t newSize);
+void* slabMalloc(int sizeClass, bool* zero);
+void slabNew(int sizeClass, kma_size_t alignment);
+void slabFree(void* ptr, kma_size_t size);
 void initialize();
-pageListNode* fillWithEmptyPageNodes(kma_page_t* pageListPage, int offsetFromHead);
-freeListNode* fillWithEmptyFreeNodes(kma_page_t* freeListPage, int offsetFromHead);
 void getNewDataPage();
-void getNewPageListPage();
-void getNewFreeListPage();
 int pow2roundup (int x);
-freeListNode* getBestFitFreeNode(kma_size_t size);
-freeListNode* divideBuffer(freeListNode* node, kma_size_t size);
-void addFreeListNode(void* buffLocation, kma_size_t buffSize);
-void removeFreeListNode(freeListNode* node);
-void removeFreeListPage(kma_page_t* pageToDelete);
-void updateBitMap(freeListNode* freeNode, pageListNode* pageNode, bool set);
-pageListNode* getPageNode(freeListNode* freeNode);
-bool isBuffInPage(freeListNode* freeNode, pageListNode* pageNode);
-bool isDataPageEmpty(pageListNode* pageNode);
-void removeDataPage(pageListNode* pageToDelete);
-void removePageListPage(kma_page_t* pageToDelete);
-void coalesce(freeListNode* freeNode);
+int bestChild(unsigned char* tree, int node, int want);
+void updateTree(pageTable* table, int node);
+void updateDirectory(int index);
+void removeDataPage(pageTable* table, int slot);
 void cleanUp();
+int blockOrder(void* ptr);
+bool useBlocks(pageTable* table, int slot, int block, int order);
 	
 /************External Declaration*****************************************/
 
@@ -120,7 +194,7 @@ void cleanUp();
 void* kma_malloc(kma_size_t size)
 {
 	//If there are no pages yet (no KMA_mallocs have occured)
-	if (firstPageListPage == NULL)
+	if (rootPage == NULL)
 	{
 		initialize();
 	}
@@ -129,588 +203,595 @@ void* kma_malloc(kma_size_t size)
 	if (size <= 0 || size > 8192)
 		return NULL;
 
-	//Get a freeListNode containing the closest fitting buffer size available
-	freeListNode* freeNode = getBestFitFreeNode(size);
+	//Small requests are cut from slab pages so they avoid power of 2 rounding
+	if (size < SLAB_MAX_SIZE)
+		return slabMalloc(SLAB_CLASS(size), NULL);
 
-	//Divide the buffer until it is at its minimal size that still fits the request
-	freeNode = divideBuffer(freeNode, size);
+	return buddyMalloc(size, NULL);
+}
 
-	//Get the page node associated with the free node
-	pageListNode* pageNode =  getPageNode(freeNode);
+void kma_free(void* ptr, kma_size_t size)
+{
+	if (size < SLAB_MAX_SIZE)
+		slabFree(ptr, size);
+	else
+		buddyFree(ptr, size);
 
-	//Update the bitmap of buff's page to reflect allocation of buff
-	updateBitMap(freeNode, pageNode, 1);
+	return;
+}
 
-	//Get the address of the buffer to return
-	void* buff = freeNode->buffLocation;
+void kma_free_unsized(void* ptr)
+{
+	int order = blockOrder(ptr);
 
-	//Remove the freeNode from the free node list (it's now allocated)
-	removeFreeListNode(freeNode);
+	if (order < 0)
+		slabFree(ptr, 0);
+	else
+		buddyFree(ptr, MIN_BLOCK_SIZE << order);
 
-	return buff;
+	return;
 }
 
-void kma_free(void* ptr, kma_size_t size)
+//The class of a slab object is in its slab's header, a buddy block is as large as its order
+kma_size_t kma_usable_size(void* ptr)
 {
-	//Round size up to a power of 2 (this is the size of the buffer it was actually given)
-	size = pow2roundup(size);
+	int order = blockOrder(ptr);
 
-	//Create free node for newly freed block of memory
-	addFreeListNode(ptr, size);
+	if (order < 0)
+		return kSlabClassSize[SLAB_HEADER(ptr)->sizeClass];
 
-	//Get pointer to newly created free node
-	freeListNode* newFreeNode = FILLED_FREE_NODE_LIST(size);
+	return MIN_BLOCK_SIZE << order;
+}
 
-	//Get the page node associated with the free node
-	pageListNode* pageNode =  getPageNode(newFreeNode);
+//Returns the order of the allocated block ptr is in, or -1 if ptr is a slab object. The nodes
+//under an allocated block keep the values of a whole free block, which are never 0, so the block
+//is the first node that is 0 on the way up from its smallest block. None of the nodes looked at
+//change while the block is allocated
+int blockOrder(void* ptr)
+{
+	pageTable* table = TABLE_OF(ptr);
+	int node = BLOCK_NODE(ptr, 0);
+	int order = 0;
 
-	//Update bitmap to reflect newly freed block of memory
-	updateBitMap(newFreeNode, pageNode, 0);
+	while (table->tree[node] != 0)
+	{
+		node = node/2;
+		order++;
+	}
 
+	//Objects of a slab can be anywhere in its block
+	if (order == SLAB_ORDER && table->tree[2*node] == SLAB_MARK)
+		return -1;
 
-	coalesce(newFreeNode);
+	return order;
+}
 
-	//If there is currently a size 8192 buffer available, we just made an empty page (and it should be destroyed)
-	if (FILLED_PAGE_NODE_LIST->nextNode != NULL && FILLED_FREE_NODE_LIST(8192) != NULL)
-		removeDataPage(pageNode);
+void* kma_realloc(void* ptr, kma_size_t oldSize, kma_size_t newSize)
+{
+	if (newSize <= 0 || newSize > 8192)
+		return NULL;
 
+	//Objects of the same slab size class need nothing done
+	if (oldSize < SLAB_MAX_SIZE && newSize < SLAB_MAX_SIZE && SLAB_CLASS(oldSize) == SLAB_CLASS(newSize))
+		return ptr;
 
-	//If there is currently only one data page and it's empty
-	else if (FILLED_PAGE_NODE_LIST->nextNode == NULL && FILLED_FREE_NODE_LIST(8192) != NULL)
-		//Remove all pages
-		cleanUp();
-	
-	return;
+	//Buddy blocks shrink by giving back their upper halves and grow by taking in free buddies
+	if (oldSize >= SLAB_MAX_SIZE && newSize >= SLAB_MAX_SIZE && buddyResize(ptr, oldSize, newSize))
+		return ptr;
+
+	//Otherwise copy it to a new buffer
+	void* newPtr = kma_malloc(newSize);
+
+	memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+	kma_free(ptr, oldSize);
+
+	return newPtr;
 }
 
-void initialize()
+//Buddy blocks are aligned to their size, so a block of the alignment's order is shrunk to the
+//size. Slab objects come from the smallest size class whose objects are all aligned, or else
+//are the first object of a new slab
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
 {
-	//######################################//
-	//##### Prepare 1st page list page #####//
-	//######################################//
-
-	//Allocate first page list page (pointed to by firstPageListPage)
-	firstPageListPage = get_page();
-
-	//Fill page list page with empty page nodes leaving room for the pointers to
-	//the free list page, the first filled node, and the first empty node. Also,
-	//fill the pointer to the first empty page node
-	EMPTY_PAGE_NODE_LIST = fillWithEmptyPageNodes(firstPageListPage, 3*sizeof(int*));
-
-	//Create pointer to first filled page node and set equal to NULL
-	FILLED_PAGE_NODE_LIST = NULL;
-
-	//######################################//
-	//##### Prepare 1st free list page #####//
-	//######################################//
-
-	//Allocate a free list page (first entry in page list) and
-	//put a pointer to it at the head of the first page list page
-	kma_page_t* freeListPage = get_page();
-	*((kma_page_t**)firstPageListPage->ptr) = freeListPage;
-
-	//Fill free list page with empty free nodes leaving room for the pointers to
-	//the first filled nodes of different buff sizes and the first empty node. Also,
-	//fill the pointer to the first empty page node
-	EMPTY_FREE_NODE_LIST = fillWithEmptyFreeNodes(freeListPage, 11*sizeof(int*));
-
-	int size;
-	//Set pointers to first filled free nodes of all different lists equal to NULL
-	for (size = 16; size <= 8192; size = size*2)
+	if (rootPage == NULL)
 	{
-		FILLED_FREE_NODE_LIST(size) = NULL;
+		initialize();
 	}
 
-	//##################################//
-	//##### Prepare 1st data  page #####//
-	//##################################//
+	if (size <= 0 || size > 8192 || alignment <= 0 || alignment > 8192 || (alignment & (alignment - 1)) != 0)
+		return NULL;
 
-	//Create first data page and fill a node for it
-	getNewDataPage();
+	if (size < SLAB_MAX_SIZE)
+	{
+		int sizeClass;
 
-}
+		for (sizeClass = SLAB_CLASS(size); sizeClass < SLAB_CLASS_COUNT; sizeClass++)
+		{
+			if (kSlabClassSize[sizeClass] % alignment == 0)
+				return slabMalloc(sizeClass, NULL);
+		}
 
-pageListNode* fillWithEmptyPageNodes(kma_page_t* pageListPage, int offsetFromHead)
-{
-	//Get a pointer to the effective head of the page and type cast it to pageListNode
-	pageListNode* pageNode = (pageListNode*)((void*)pageListPage->ptr + offsetFromHead);
-	//Save the location of the first node
-	pageListNode* firstPageNode = pageNode;
-	//Get a pointer to the effective end of the page (making room for an int)
-	void* effectivePageEnd = (void*)pageListPage->ptr + pageListPage->size - sizeof(int);
-	//Fill in the int we made room for with zero. This is the count of the nubmer of filled
-	//nodes on the page
-	*(int*)effectivePageEnd = 0;
-
-	//While there is room to insert another page list node...
-	while((void*)pageNode + sizeof(pageListNode) <= effectivePageEnd)
-	{
-		//Add pointer to the pageListPage to each new empty page node
-		pageNode->myPage = pageListPage;
-		//Add pointer to the next empty node to each new empty page node
-		pageNode->nextNode = pageNode + 1;
-		//Go to the next empty page node
-		pageNode = pageNode + 1;
+		//The first object of a new slab is aligned to its block
+		slabNew(SLAB_CLASS(size), alignment);
+
+		return slabMalloc(SLAB_CLASS(size), NULL);
 	}
 
-	//Make the nextNode pointer in the last pageNode = NULL
-	(pageNode - 1)->nextNode = NULL;
+	if (alignment <= pow2roundup(size))
+		return buddyMalloc(size, NULL);
 
-	//Return pointer to the head of the empty node list
-	return firstPageNode;
+	void* ptr = buddyMalloc(alignment, NULL);
 
+	buddyResize(ptr, alignment, size);
+
+	return ptr;
 }
 
-freeListNode* fillWithEmptyFreeNodes(kma_page_t* freeListPage, int offsetFromHead)
+//Buddy blocks keep nothing in them, so a block none of whose 512 byte blocks was handed out
+//before is still zero, and so are the objects carved from a slab on such a block. Recycled
+//slab objects were used before
+void* kma_calloc(kma_size_t count, kma_size_t size)
 {
+	//Nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+	//which together keep count * size from overflowing
+	if (count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+		return NULL;
 
-	//Get a pointer to the effective head of the page and type cast it to freeListNode
-	freeListNode* freeNode = (freeListNode*)((void*)freeListPage->ptr + offsetFromHead);
-	//Save the location of the first node
-	freeListNode* firstFreeNode = freeNode;
-	//Get a pointer to the effective end of the page (making room for an int)
-	void* effectivePageEnd = (void*)freeListPage->ptr + freeListPage->size - sizeof(int);
-	//Fill in the int we made room for with zero. This is the count of the nubmer of filled
-	//nodes on the page
-	*(int*)effectivePageEnd = 0;
-
-	//While there is room to insert another page list node...
-	while((void*)freeNode + sizeof(freeListNode) <= effectivePageEnd)
+	if (rootPage == NULL)
 	{
-		//Add pointer to the freeListPage to each new empty free node
-		freeNode->myPage = freeListPage;
-		//Add pointer to the next empty node to each new empty free node
-		freeNode->nextNode = freeNode + 1;
-		//Go to the next empty free node
-		freeNode = freeNode + 1;
+		initialize();
 	}
 
-	//Make the nextNode pointer in the last freeNode = NULL
-	(freeNode - 1)->nextNode = NULL;
+	size = count * size;
+
+	bool zero;
+	void* ptr = (size < SLAB_MAX_SIZE) ? slabMalloc(SLAB_CLASS(size), &zero) : buddyMalloc(size, &zero);
 
-	//Return pointer to the head of the empty node list
-	return firstFreeNode;
+	if (!zero)
+		memset(ptr, 0, size);
 
+	return ptr;
 }
 
-//Gets a new data page and puts a new page node at the front of the filled node list
-void getNewDataPage()
+//Sets zero, unless it is NULL, to whether the block was never handed out since its page came zeroed
+void* buddyMalloc(kma_size_t size, bool* zero)
 {
-	//If there isn't an empty page node to use, request a new page list page
-	if(EMPTY_PAGE_NODE_LIST == NULL)
-		getNewPageListPage();
-
-	//Get an empty page node
-	pageListNode* newPageNode = EMPTY_PAGE_NODE_LIST;
-	//Make empty page node list point to the next node in the list
-	EMPTY_PAGE_NODE_LIST = EMPTY_PAGE_NODE_LIST->nextNode;
-	//Increment node counter at the end of the page
-	NODE_COUNT(newPageNode->myPage) = NODE_COUNT(newPageNode->myPage) + 1;
-	//Allocate new data page
-	newPageNode->dataPage = get_page();
-	//Clear bitMap
-	int i;
-	for (i = 0; i < 64; i++)
-	{
-		newPageNode->bitMap[i] = '\0';
-	}
-	//Make node point to first node in the filled page node list
-	newPageNode->nextNode = FILLED_PAGE_NODE_LIST;
-	//Make filled page node list point to the new node (insert in front)
-	FILLED_PAGE_NODE_LIST = newPageNode;
+	int order = SIZE_ORDER(pow2roundup(size));
+	int want = order + 1;
+	int node;
 
-	//Create an entry in the size 8192 free list for this new buffer
-	addFreeListNode(newPageNode->dataPage->ptr, 8192);
+	//If no page has a free block that large, get a new data page
+	if (ROOT->tree[1] < want)
+		getNewDataPage();
 
-	return;
-}
+	//Walk down the directory to the page table page, then down its tree to a free block
+	//of the right order
+	for (node = 1; node < DIRECTORY_SIZE; node = bestChild(ROOT->tree, node, want));
 
-void getNewPageListPage()
-{
-	//Get a new page of memory
-	kma_page_t* newPageListPage = get_page();
+	int index = node - DIRECTORY_SIZE;
+	pageTable* table = ROOT->directory[index];
+	int level = BLOCK_LEVEL - order;
 
-	//Fill page list page with empty page nodes and make the empty page node list
-	//point to the first new empty page node of the new page
-	EMPTY_PAGE_NODE_LIST = fillWithEmptyPageNodes(newPageListPage, 0);
+	for (node = 1; node < (1 << level); node = bestChild(table->tree, node, want));
 
-	return;
+	//Mark the block allocated and bring its ancestors up to date
+	table->tree[node] = 0;
+	updateTree(table, node);
+	updateDirectory(index);
+
+	//Work out which page the block is on and where on the page
+	int position = node - (1 << level);
+	int slot = position >> (BUDDY_ORDERS - 1 - order);
+	int block = position & ((1 << (BUDDY_ORDERS - 1 - order)) - 1);
+
+	bool fresh = useBlocks(table, slot, block, order);
+	if (zero != NULL)
+		*zero = fresh;
+
+	return (void*)table->dataPage[slot]->ptr + block*(MIN_BLOCK_SIZE << order);
 }
 
-void getNewFreeListPage()
+//Marks the 512 byte blocks under block number block of an order on a data page as handed out.
+//Returns TRUE if none of them was before
+bool useBlocks(pageTable* table, int slot, int block, int order)
 {
-	//Get a new page of memory
-	kma_page_t* newFreeListPage = get_page();
+	unsigned short mask = ((1 << (1 << order)) - 1) << (block << order);
+	bool fresh = (table->usedBlocks[slot] & mask) == 0;
 
-	//Fill page list page with empty free nodes and make the empty free node list
-	//point to the first new empty free node of the new page
-	EMPTY_FREE_NODE_LIST = fillWithEmptyFreeNodes(newFreeListPage, 0);
+	table->usedBlocks[slot] = table->usedBlocks[slot] | mask;
 
-	return;
+	return fresh;
 }
 
-int pow2roundup (int x)
+void buddyFree(void* ptr, kma_size_t size)
 {
-    --x;
-    x |= x >> 1;
-    x |= x >> 2;
-    x |= x >> 4;
-    x |= x >> 8;
-    x |= x >> 16;
-    return (x+1 < 16) ? 16 : x + 1;
+	//Round size up to a power of 2 (this is the size of the buffer it was actually given)
+	int order = SIZE_ORDER(pow2roundup(size));
+	long pageNumber = PAGE_NUMBER(ptr);
+	int index = DIRECTORY_INDEX(pageNumber);
+	pageTable* table = ROOT->directory[index];
+	int slot = pageNumber % PAGE_TABLE_SLOTS;
+	int block = (ptr - BASEADDR(ptr)) / (MIN_BLOCK_SIZE << order);
+
+	//Mark the block free, updateTree merges it with its buddy on the way up
+	int node = (1 << (BLOCK_LEVEL - order)) + (slot << (BUDDY_ORDERS - 1 - order)) + block;
+	table->tree[node] = order + 1;
+	updateTree(table, node);
+
+	//If the whole page is one free block again, give it back
+	if (table->tree[(1 << PAGE_LEVEL) + slot] == BUDDY_ORDERS)
+		removeDataPage(table, slot);
+	else
+		updateDirectory(index);
+
+	//If that was the last data page, remove all pages
+	if (ROOT->dataPageCount == 0)
+		cleanUp();
+
+	return;
 }
 
-freeListNode* getBestFitFreeNode(kma_size_t size)
+//Changes the order of an allocated block without moving it. Returns FALSE if it has to grow
+//but isn't the first block of the larger one or the buddies it would take in aren't free
+bool buddyResize(void* ptr, kma_size_t oldSize, kma_size_t newSize)
 {
-	//Round up size to a power of 2
-	size = pow2roundup(size);
+	int oldOrder = SIZE_ORDER(pow2roundup(oldSize));
+	int newOrder = SIZE_ORDER(pow2roundup(newSize));
+	long pageNumber = PAGE_NUMBER(ptr);
+	int index = DIRECTORY_INDEX(pageNumber);
+	pageTable* table = ROOT->directory[index];
+	int slot = pageNumber % PAGE_TABLE_SLOTS;
+	int block = (ptr - BASEADDR(ptr)) / (MIN_BLOCK_SIZE << oldOrder);
+	int node = (1 << (BLOCK_LEVEL - oldOrder)) + (slot << (BUDDY_ORDERS - 1 - oldOrder)) + block;
+	int order;
+
+	if (newOrder == oldOrder)
+		return TRUE;
 
-	//Get smallest available buffer that will fit the request
-	freeListNode* freeNode = NULL;
-	while (freeNode == NULL && size <= 8192)
+	//The nodes under an allocated block keep the values they had when it was one whole free
+	//block, so shrinking is marking its first block of the new order allocated instead
+	if (newOrder < oldOrder)
 	{
-		freeNode = FILLED_FREE_NODE_LIST(size);
-		size = size * 2;
+		int first = node << (oldOrder - newOrder);
+
+		table->tree[first] = 0;
+		updateTree(table, first);
+		updateDirectory(index);
+
+		return TRUE;
 	}
 
-	//If there aren't any available buffers
-	if (freeNode == NULL)
+	//Growing needs the block to be the left half at every order up to the new one, with a
+	//whole free right half
+	int parent = node;
+	for (order = oldOrder; order < newOrder; order++)
 	{
-		//Allocate a new data page and do all of the book keeping
-		getNewDataPage();
-		//Set freeNode equal to the node just created by getNewDataPage
-		freeNode = FILLED_FREE_NODE_LIST(8192);
+		if ((parent & 1) || table->tree[parent + 1] != order + 1)
+			return FALSE;
+
+		parent = parent/2;
 	}
 
+	//Make the nodes in between whole free blocks again, as they would be under any
+	//allocated block, then mark the larger block allocated
+	for (order = oldOrder; order < newOrder; order++)
+	{
+		table->tree[node] = order + 1;
+		node = node/2;
+	}
+	table->tree[parent] = 0;
+	updateTree(table, parent);
+	updateDirectory(index);
+	useBlocks(table, slot, (ptr - BASEADDR(ptr)) / (MIN_BLOCK_SIZE << newOrder), newOrder);
 
-	return freeNode;
+	return TRUE;
 }
 
-freeListNode* divideBuffer(freeListNode* node, kma_size_t size)
+//Sets zero, unless it is NULL, to whether the object is carved from a slab whose block was zero
+void* slabMalloc(int sizeClass, bool* zero)
 {
-	//Round up size to a power of 2
-	size = pow2roundup(size);
+	slabHeader* slab = gSlabPartialList[sizeClass];
+	void* obj;
 
-	//Size of buffs you are creating via division in each loop iteration
-	int nextSize;
+	//If no slab of this class has a free object, make a new one
+	if (slab == NULL)
+	{
+		slabNew(sizeClass, SLAB_SIZE);
+		slab = gSlabPartialList[sizeClass];
+	}
 
-	//Until we reach the target size...
-	while (node->buffSize != size)
+	//Reuse a recycled object if there is one, otherwise carve a new one off the page
+	if (slab->freeObjList != NULL)
+	{
+		obj = slab->freeObjList;
+		slab->freeObjList = *(void**)obj;
+		if (zero != NULL)
+			*zero = FALSE;
+	}
+	else
 	{
-		//Calculate the size of the new buffers we're creating
-		nextSize = (node->buffSize)/2;
-		//Create two new buffers from the old buffer
-		addFreeListNode(node->buffLocation, nextSize);
-		addFreeListNode(node->buffLocation + nextSize, nextSize);
-		//Remove reference to the old buffer
-		removeFreeListNode(node);
-		//Update node to reference the new buffer that's on the "left" (lower memory address)
-		node = FILLED_FREE_NODE_LIST(nextSize);
+		obj = SLAB_START(slab) + slab->carveOffset;
+		slab->carveOffset = slab->carveOffset + kSlabClassSize[sizeClass];
+		if (zero != NULL)
+			*zero = slab->zero;
 	}
 
-	return node;
-}
+	slab->freeCount = slab->freeCount - 1;
 
-void addFreeListNode(void* buffLocation, kma_size_t buffSize)
-{
-	//If there isn't an empty free node to use, request a new free list page
-	if(EMPTY_FREE_NODE_LIST == NULL)
-		getNewFreeListPage();
-
-	//Get an empty free node
-	freeListNode* newFreeNode = EMPTY_FREE_NODE_LIST;
-	//Make empty free node list point to the next node in the list
-	EMPTY_FREE_NODE_LIST = EMPTY_FREE_NODE_LIST->nextNode;
-	//Increment node counter at the end of the page
-	NODE_COUNT(newFreeNode->myPage) = NODE_COUNT(newFreeNode->myPage) + 1;
-	//Fill pointer to buffer location
-	newFreeNode->buffLocation = buffLocation;
-	//Fill buffer size
-	newFreeNode->buffSize = buffSize;
-	//Make node point to the first node in the filled free node list of buffSize
-	newFreeNode->nextNode = FILLED_FREE_NODE_LIST(buffSize);
-	//Make filled free node list of buffSize point to the new node (insert in front)
-	FILLED_FREE_NODE_LIST(buffSize) = newFreeNode;
+	//A full slab leaves the partial list; kma_free finds it again through BASEADDR
+	if (slab->freeCount == 0)
+	{
+		gSlabPartialList[sizeClass] = slab->nextSlab;
+		if (slab->nextSlab != NULL)
+			slab->nextSlab->prevSlab = NULL;
+	}
 
-	return;
+	return obj;
 }
-void removeFreeListNode(freeListNode* nodeToDelete)
-{
-	//Get size of the node to remove from list
-	kma_size_t size = nodeToDelete->buffSize;
 
-	//Get the head of the list for the buffSize (will be used to traverse the list)
-	freeListNode* leadNode = FILLED_FREE_NODE_LIST(size);
-	//Trails lead node when traversing the list
-	freeListNode* followNode = NULL;
+//Takes a large block from the buddy allocator for a slab and puts it first on the partial list.
+//For an alignment above the slab size, a block of the alignment's order is shrunk to the slab
+void slabNew(int sizeClass, kma_size_t alignment)
+{
+	void* start;
+	bool zero;
 
-	while (leadNode != nodeToDelete)
+	if (alignment > SLAB_SIZE)
 	{
-		followNode = leadNode;
-		leadNode = leadNode->nextNode;
+		start = buddyMalloc(alignment, &zero);
+		buddyResize(start, alignment, SLAB_SIZE);
 	}
-
-	//Remove the node from its list
-	if (followNode == NULL)
-		FILLED_FREE_NODE_LIST(size) = leadNode->nextNode;
 	else
-		followNode->nextNode = leadNode->nextNode;
+	{
+		start = buddyMalloc(SLAB_SIZE, &zero);
+	}
 
-	//Add the node to the empty list
-	leadNode->nextNode = EMPTY_FREE_NODE_LIST;
-	EMPTY_FREE_NODE_LIST = leadNode;
+	slabHeader* slab = SLAB_HEADER(start);
 
-	NODE_COUNT(leadNode->myPage) = NODE_COUNT(leadNode->myPage) - 1;
+	TABLE_OF(start)->tree[2*BLOCK_NODE(start, SLAB_ORDER)] = SLAB_MARK;
 
-	//If the page that leadNode is on no longer has any filled nodes and isn't the first free list page
-	if (NODE_COUNT(leadNode->myPage) == 0 && leadNode->myPage != FIRST_FREE_LIST_PAGE)
-		removeFreeListPage(leadNode->myPage);
+	slab->prevSlab = NULL;
+	slab->nextSlab = gSlabPartialList[sizeClass];
+	if (slab->nextSlab != NULL)
+		slab->nextSlab->prevSlab = slab;
+	slab->freeObjList = NULL;
+	slab->carveOffset = 0;
+	slab->sizeClass = sizeClass;
+	slab->zero = zero;
+	slab->objCount = (SLAB_SIZE - sizeof(slabHeader))/kSlabClassSize[sizeClass];
+	slab->freeCount = slab->objCount;
+	gSlabPartialList[sizeClass] = slab;
 
 	return;
 }
 
-void removeFreeListPage(kma_page_t* pageToDelete)
+void slabFree(void* ptr, kma_size_t size)
 {
-	//Get the head of the list for the empty free nodes
-	freeListNode* leadNode = EMPTY_FREE_NODE_LIST;
-	//Trails lead node when traversing the list
-	freeListNode* followNode = NULL;
+	slabHeader* slab = SLAB_HEADER(ptr);
+	int sizeClass = slab->sizeClass;
 
-	//Iterate through the entire list of empty free nodes and remove all nodes on pageToDelete
-	while (leadNode != NULL)
+	//Push the object onto the slab's recycled object list
+	*(void**)ptr = slab->freeObjList;
+	slab->freeObjList = ptr;
+	slab->freeCount = slab->freeCount + 1;
+
+	//If the slab was full, put it back at the front of the partial list
+	if (slab->freeCount == 1)
 	{
-		//If the current node is on the page to delete
-		if (leadNode->myPage == pageToDelete)
-		{
-			//Remove the node from the list
-			if (followNode == NULL)
-				EMPTY_FREE_NODE_LIST = leadNode->nextNode;
-			else
-				followNode->nextNode = leadNode->nextNode;
-			//Go to the next node (follow node stays the same)
-			leadNode = leadNode->nextNode;
-		}
+		slab->prevSlab = NULL;
+		slab->nextSlab = gSlabPartialList[sizeClass];
+		if (slab->nextSlab != NULL)
+			slab->nextSlab->prevSlab = slab;
+		gSlabPartialList[sizeClass] = slab;
+	}
 
+	//If every object of the slab is free, hand the page back to the buddy allocator
+	if (slab->freeCount == slab->objCount)
+	{
+		if (slab->prevSlab == NULL)
+			gSlabPartialList[sizeClass] = slab->nextSlab;
 		else
-		{
-			//Increment the lead node and the follow node
-			followNode = leadNode;
-			leadNode = leadNode->nextNode;
-		}
-	}
+			slab->prevSlab->nextSlab = slab->nextSlab;
+		if (slab->nextSlab != NULL)
+			slab->nextSlab->prevSlab = slab->prevSlab;
 
-	//Free the input page
-	free_page(pageToDelete);
+		//The left child is a whole free block again before the block is freed
+		TABLE_OF(slab)->tree[2*BLOCK_NODE(SLAB_START(slab), SLAB_ORDER)] = SLAB_ORDER;
+		buddyFree(SLAB_START(slab), SLAB_SIZE);
+	}
 
 	return;
 }
 
-void updateBitMap(freeListNode* freeNode, pageListNode* pageNode, bool set) 
+void initialize()
 {
-	//Update the bitmap to reflect all newly allocated buffers
 	int i;
-	int startLocation = (freeNode->buffLocation - pageNode->dataPage->ptr)/16; //Starting bit in bitmap
-	int byte; //Used to get the correct byte in bitmap given a bit
-	int bit; //Used to get the correct bit within the byte
 
-	//If we are setting blocks to mark as allocated...
-	if (set)
-		for (i = startLocation; i < startLocation+(freeNode->buffSize/16); i++)
-		{
-			byte = i/8; //Used tp access correct byte in bitmap
-			bit = i%8; //Used to set correct bit in byte
-			pageNode->bitMap[byte] |= 0x80 >> bit; // set bit by or-ing byte sized portion of the bitmap with a mask
-		}
-	//If we are clearing blocks to mark as free...
-	else
+	//Allocate the root page (pointed to by rootPage). It holds the directory of page table pages
+	//and the tree over it. Data pages and page table pages are only taken when needed
+	rootPage = get_page();
+
+	for (i = 0; i < 2*DIRECTORY_SIZE; i++)
 	{
-		for (i = startLocation; i < startLocation+(freeNode->buffSize/16); i++)
-		{
-			byte = i/8; //Used tp access correct byte in bitmap
-			bit = i%8; //Used to set correct bit in byte
-			pageNode->bitMap[byte] &= ~(0x80 >> bit); // clear bit by and-ing byte sized portion of the bitmap with a mask
-		}
+		ROOT->tree[i] = 0;
 	}
+	for (i = 0; i < DIRECTORY_SIZE; i++)
+	{
+		ROOT->directory[i] = NULL;
+	}
+	ROOT->dataPageCount = 0;
 
 	return;
 }
 
-pageListNode* getPageNode(freeListNode* freeNode)
+//Gets a new data page and describes it in the slot of its page number
+void getNewDataPage()
 {
-	//Get the first node of the page list
-	pageListNode* pageNode = FILLED_PAGE_NODE_LIST;
+	int i;
+	int level;
+
+	//Allocate new data page
+	kma_page_t* dataPage = get_page();
+	long pageNumber = PAGE_NUMBER(dataPage->ptr);
+	int index = DIRECTORY_INDEX(pageNumber);
 
-	//Find the page node that corresponds to the data page that buff is in
-	while(pageNode != NULL && !isBuffInPage(freeNode, pageNode))
+	//If no page table page describes the page's group yet, request one
+	if (ROOT->directory[index] == NULL)
 	{
-		pageNode = pageNode->nextNode;
+		kma_page_t* tablePage = get_page();
+		pageTable* table = (pageTable*)tablePage->ptr;
+
+		table->myPage = tablePage;
+		table->group = pageNumber / PAGE_TABLE_SLOTS;
+		table->usedSlots = 0;
+		for (i = 0; i < TREE_SIZE; i++)
+		{
+			table->tree[i] = 0;
+		}
+		for (i = 0; i < PAGE_TABLE_SLOTS; i++)
+		{
+			table->dataPage[i] = NULL;
+		}
+		ROOT->directory[index] = table;
 	}
 
-	return pageNode;
-}
+	pageTable* table = ROOT->directory[index];
+	int slot = pageNumber % PAGE_TABLE_SLOTS;
 
-//Returns true if freeNode reffers to a buffer that is in the data page held by page node
-bool isBuffInPage(freeListNode* freeNode, pageListNode* pageNode)
-{
-	void* pageHead = pageNode->dataPage->ptr;
-	void* pageEnd = pageNode->dataPage->ptr + 8192;
+	assert(table->group == pageNumber / PAGE_TABLE_SLOTS);
 
-	if(freeNode->buffLocation >= pageHead && freeNode->buffLocation < pageEnd)
-		return TRUE;
-	else
-		return FALSE;
-}
+	table->dataPage[slot] = dataPage;
+	table->usedBlocks[slot] = dataPage->zero ? 0 : 0xFFFF;
+	table->usedSlots = table->usedSlots + 1;
+	ROOT->dataPageCount = ROOT->dataPageCount + 1;
 
-bool isDataPageEmpty(pageListNode* pageNode)
-{
-	//Assume the list is empty
-	bool isEmpty = TRUE;
-	int i;
-
-	//Check every char in the bitmap
-	for(i = 0; i < 64; i++)
+	//Mark the page and every block under it free (a slot's subtree is left as it was when its
+	//last data page went away)
+	for (level = PAGE_LEVEL; level <= BLOCK_LEVEL; level++)
 	{
-		//If a single char in the bitmap isn't the null character
-		if (pageNode->bitMap[i] != '\0')
-			//Mark the data page as not empty
-			isEmpty = FALSE;
+		int first = (1 << level) + (slot << (level - PAGE_LEVEL));
+
+		for (i = 0; i < (1 << (level - PAGE_LEVEL)); i++)
+		{
+			table->tree[first + i] = BLOCK_LEVEL - level + 1;
+		}
 	}
 
-	return isEmpty;
+	updateTree(table, (1 << PAGE_LEVEL) + slot);
+	updateDirectory(index);
+
+	return;
 }
 
-void removeDataPage(pageListNode* pageToDelete)
+int pow2roundup (int x)
 {
-	//Remove the (only) free node of size 8192 (it should belong to the page we're deleting
-	//because we only delete empty pages)
-	removeFreeListNode(FILLED_FREE_NODE_LIST(8192));
+    --x;
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 4;
+    x |= x >> 8;
+    x |= x >> 16;
+    return (x+1 < 16) ? 16 : x + 1;
+}
 
-	free_page(pageToDelete->dataPage);
+//Returns the child of node to walk down to for a free block of order want - 1. If both
+//children have one, it takes the one whose largest free block is smaller, so large free
+//blocks and lightly used pages are left alone as long as possible
+int bestChild(unsigned char* tree, int node, int want)
+{
+	int left = tree[2*node];
+	int right = tree[2*node + 1];
 
-	pageListNode* leadNode = FILLED_PAGE_NODE_LIST;
-	pageListNode* followNode = NULL;
+	if (left >= want && (right < want || left <= right))
+		return 2*node;
 
-	while (leadNode != pageToDelete)
+	return 2*node + 1;
+}
+
+//Recomputes the ancestors of node after it changed, stopping as soon as one stays the same.
+//Below the page level two whole free buddies make their parent a whole free block
+void updateTree(pageTable* table, int node)
+{
+	while (node > 1)
 	{
-		followNode = leadNode;
-		leadNode = leadNode->nextNode;
-	}
+		node = node/2;
 
-	//Remove the node from the filled page node page list
-	if(followNode == NULL)
-		FILLED_PAGE_NODE_LIST = leadNode->nextNode;
-	else
-		followNode->nextNode = leadNode->nextNode;
+		int left = table->tree[2*node];
+		int right = table->tree[2*node + 1];
+		int level = NODE_LEVEL(node);
+		int value;
 
-	//Add the node to the empty page node list
-	leadNode->nextNode = EMPTY_PAGE_NODE_LIST;
-	EMPTY_PAGE_NODE_LIST = leadNode;
+		if (level >= PAGE_LEVEL && left == BLOCK_LEVEL - level && right == left)
+			value = left + 1;
+		else
+			value = left > right ? left : right;
 
-	//Decrement the node count for leadNode's page and check to see if that page should be freed
-	NODE_COUNT(leadNode->myPage) = NODE_COUNT(leadNode->myPage) - 1;
+		if (table->tree[node] == value)
+			break;
 
-	if(NODE_COUNT(leadNode->myPage) == 0 && leadNode->myPage != firstPageListPage)
-		removePageListPage(leadNode->myPage);
+		table->tree[node] = value;
+	}
 
 	return;
 }
-void removePageListPage(kma_page_t* pageToDelete)
+
+//Copies the root of a page table page's tree into its directory leaf and recomputes the
+//directory tree above it
+void updateDirectory(int index)
 {
-	//Get the head of the list for the empty page nodes
-	pageListNode* leadNode = EMPTY_PAGE_NODE_LIST;
-	//Trails lead node when traversing the list
-	pageListNode* followNode = NULL;
+	int node = DIRECTORY_SIZE + index;
+	pageTable* table = ROOT->directory[index];
+	int value = table == NULL ? 0 : table->tree[1];
 
-	//Iterate through the entire list of empty page nodes and remove all nodes on pageToDelete
-	while (leadNode != NULL)
+	while (ROOT->tree[node] != value)
 	{
-		//If the current node is on the page to delete
-		if (leadNode->myPage == pageToDelete)
-		{
-			//Remove the node from the list
-			if (followNode == NULL)
-				EMPTY_PAGE_NODE_LIST = leadNode->nextNode;
-			else
-				followNode->nextNode = leadNode->nextNode;
-			//Go to the next node (follow node stays the same)
-			leadNode = leadNode->nextNode;
-		}
+		ROOT->tree[node] = value;
 
-		else
-		{
-			//Increment the lead node and the follow node
-			followNode = leadNode;
-			leadNode = leadNode->nextNode;
-		}
-	}
+		if (node == 1)
+			break;
 
-	//Free the input page
-	free_page(pageToDelete);
+		int sibling = ROOT->tree[node ^ 1];
+		node = node/2;
+		value = value > sibling ? value : sibling;
+	}
 
 	return;
 }
 
-void coalesce(freeListNode* freeNode)
+void removeDataPage(pageTable* table, int slot)
 {
-	//If buffSize of freenode is 8192, return (nothing to coalesce)
-	if (freeNode->buffSize == 8192)
-		return;
+	int index = DIRECTORY_INDEX(table->group*PAGE_TABLE_SLOTS);
 
-	void* buddyBuffLocation;
+	free_page(table->dataPage[slot]);
 
-	//Get the location of the buddy buffer
-	buddyBuffLocation =  (void*)((long)freeNode->buffLocation ^ (long)freeNode->buffSize);
+	//Release the slot, a page node of 0 keeps searches out of it
+	table->dataPage[slot] = NULL;
+	table->tree[(1 << PAGE_LEVEL) + slot] = 0;
+	updateTree(table, (1 << PAGE_LEVEL) + slot);
+	table->usedSlots = table->usedSlots - 1;
+	ROOT->dataPageCount = ROOT->dataPageCount - 1;
 
-	//Get freeNode's buddy
-	freeListNode* freeBuddyNode = FILLED_FREE_NODE_LIST(freeNode->buffSize);
-	while ((int)freeBuddyNode != 0 && freeBuddyNode->buffLocation != buddyBuffLocation)
+	//Free the page table page if none of its slots are used
+	if (table->usedSlots == 0)
 	{
-		freeBuddyNode = freeBuddyNode->nextNode;
+		ROOT->directory[index] = NULL;
+		free_page(table->myPage);
 	}
 
-	//If freeNode's buddy is allocated (can't find a filled free node of that buddy's buff address), return (can't coalesce)
-	if ((int)freeBuddyNode == 0)
-		return;
-
-	//Add free node the combines freeNode and Buddy
-	addFreeListNode(MIN_ADDR(freeNode->buffLocation, freeBuddyNode->buffLocation) ,freeNode->buffSize*2);
-
-	//Remove free node and buddy from free node list
-	removeFreeListNode(freeNode);
-	removeFreeListNode(freeBuddyNode);
-
-	//Try to coalesce the combined node
-	coalesce(FILLED_FREE_NODE_LIST(freeNode->buffSize*2));
+	updateDirectory(index);
 
 	return;
 }
 
-//Destroy all pages when no memory is currently allocated
+//Destroy the root page when no memory is currently allocated
 void cleanUp()
 {
-	//Remove the 1st free list page (if it doesn't contain the last node)
-	if (FIRST_FREE_LIST_PAGE != FILLED_FREE_NODE_LIST(8192)->myPage)
-		free_page(FIRST_FREE_LIST_PAGE);
-
-	//Remove the free list page of last free list node
-	free_page(FILLED_FREE_NODE_LIST(8192)->myPage);
+	free_page(rootPage);
 
-	//Remove the last data page
-	free_page(FILLED_PAGE_NODE_LIST->dataPage);
-
-	//Remove the page list page of the last node (if it isn't the firstPageListPage)
-	if (FILLED_PAGE_NODE_LIST->myPage != firstPageListPage)
-		free_page(FILLED_PAGE_NODE_LIST->myPage);
-
-	//Remove the last page list page
-	free_page(firstPageListPage);
-
-	//Set firstPageListPage equal to null so things will initialize if kma_malloc is called again
-	firstPageListPage = NULL;
+	//Set rootPage equal to null so things will initialize if kma_malloc is called again
+	rootPage = NULL;
 
 	return;
 }
 
-
-
 #endif // KMA_BUD
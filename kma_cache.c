@@ -0,0 +1,440 @@
+/***************************************************************************
+ *  Title: Kernel Object Cache Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Slab object caches (Bonwick) built on the page allocator
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+#define __KCACHE_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+#include "kma_cache.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// slabs are colored in steps of one cache line (or the alignment if it is larger)
+#define CACHE_LINE 64
+
+// number of empty slabs a cache holds on to before it gives their pages back
+#define EMPTY_SLABS_KEPT 1
+
+typedef struct kma_slab kma_slab_t;
+
+// lives at the end of every slab page, the objects start at the slab's color offset.
+// Kept at 48 bytes, which lets two objects of the largest kma_slab class fit
+struct kma_slab
+{
+  kma_page_t*  page;      // the page object to hand back to free_page
+  kma_slab_t*  prev;      // neighbours on the cache's full, partial or empty list
+  kma_slab_t*  next;
+  void*        free_list; // first free object of this slab
+  short        in_use;    // number of objects handed out
+  short        color;     // offset of the first object from the start of the page
+  bool         zero;      // the free objects hold only zeros but for their links (the page
+                          // came zeroed, the cache has no constructor and nothing was freed yet)
+  kma_cache_t* cache;     // the cache the slab belongs to, last so that it shares the last word
+                          // of the page with the tag of a page of its own
+};
+
+struct kma_cache
+{
+  kma_size_t      size;        // object size
+  kma_size_t      stride;      // distance between two objects of a slab
+  kma_size_t      link_offset; // where a free object keeps its free list link
+  int             per_slab;    // number of objects of a slab
+  int             color_step;  // distance between two colors
+  int             color_max;   // largest color (the slack left at the end of a slab)
+  int             color_next;  // color of the next slab
+  kma_cache_fn_t  ctor;
+  kma_cache_fn_t  dtor;
+  kma_slab_t*     full;        // slabs with no free object
+  kma_slab_t*     partial;     // slabs with some free objects
+  kma_slab_t*     empty;       // slabs with no object in use
+  int             empty_count;
+};
+
+// returns the slab of an object
+#define SLAB_OF(obj) ((kma_slab_t*)((char*)BASEADDR(obj) + PAGESIZE - sizeof(kma_slab_t)))
+
+// the last word of a page: the cache of its slab, or for a page of its own (kma_cache_page_alloc)
+// the page object with the lowest bit set, which a cache pointer never has
+#define PAGE_TAG(obj) (*(long*)((char*)BASEADDR(obj) + PAGESIZE - sizeof(long)))
+#define OWN_PAGE_BIT 1L
+
+// returns the free list link of a free object
+#define LINK(cache, obj) (*(void**)((char*)(obj) + (cache)->link_offset))
+
+// rounds x up to a multiple of a (a power of 2)
+#define ROUND_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+/************Global Variables*********************************************/
+
+// the cache the cache descriptors come from
+static kma_cache_t gCacheCache;
+static bool gCacheCacheReady = FALSE;
+
+/************Function Prototypes******************************************/
+bool init_cache(kma_cache_t*, kma_size_t, kma_size_t, kma_cache_fn_t, kma_cache_fn_t);
+kma_slab_t* create_slab(kma_cache_t*);
+void destroy_slab(kma_cache_t*, kma_slab_t*);
+kma_slab_t* alloc_slab(kma_cache_t*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+// works out the slab layout of a cache, returns FALSE if no object fits in a page
+bool
+init_cache(kma_cache_t* cache, kma_size_t size, kma_size_t align,
+           kma_cache_fn_t ctor, kma_cache_fn_t dtor)
+{
+  if (size <= 0 || (align & (align - 1)) != 0)
+    {
+      return FALSE;
+    }
+
+  if (align < sizeof(void*))
+    {
+      align = sizeof(void*);
+    }
+
+  cache->size = size;
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+
+  if (ctor != NULL)
+    {
+      // constructed objects keep their state while free, so the link goes after the object
+      cache->link_offset = ROUND_UP(size, sizeof(void*));
+      cache->stride = ROUND_UP(cache->link_offset + sizeof(void*), align);
+    }
+  else
+    {
+      cache->link_offset = 0;
+      cache->stride = ROUND_UP(size < sizeof(void*) ? sizeof(void*) : size, align);
+    }
+
+  int usable = PAGESIZE - sizeof(kma_slab_t);
+
+  cache->per_slab = usable / cache->stride;
+  if (cache->per_slab == 0)
+    {
+      return FALSE;
+    }
+
+  // the slack at the end of a slab shifts the objects of successive slabs
+  // so they don't all start on the same cache sets
+  cache->color_step = align > CACHE_LINE ? align : CACHE_LINE;
+  cache->color_max = ((usable - cache->per_slab * cache->stride) / cache->color_step) * cache->color_step;
+  cache->color_next = 0;
+
+  cache->full = NULL;
+  cache->partial = NULL;
+  cache->empty = NULL;
+  cache->empty_count = 0;
+
+  return TRUE;
+}
+
+// returns the list a slab belongs on
+kma_slab_t**
+slab_list(kma_cache_t* cache, kma_slab_t* slab)
+{
+  if (slab->in_use == 0)
+    {
+      return &cache->empty;
+    }
+  if (slab->in_use == cache->per_slab)
+    {
+      return &cache->full;
+    }
+  return &cache->partial;
+}
+
+void
+link_slab(kma_cache_t* cache, kma_slab_t* slab)
+{
+  kma_slab_t** head = slab_list(cache, slab);
+
+  slab->prev = NULL;
+  slab->next = *head;
+  if (*head != NULL)
+    {
+      (*head)->prev = slab;
+    }
+  *head = slab;
+
+  if (slab->in_use == 0)
+    {
+      cache->empty_count++;
+    }
+}
+
+// takes a slab off its list, must be called before in_use changes
+void
+unlink_slab(kma_cache_t* cache, kma_slab_t* slab)
+{
+  kma_slab_t** head = slab_list(cache, slab);
+
+  if (slab->prev != NULL)
+    {
+      slab->prev->next = slab->next;
+    }
+  else
+    {
+      *head = slab->next;
+    }
+  if (slab->next != NULL)
+    {
+      slab->next->prev = slab->prev;
+    }
+
+  if (slab->in_use == 0)
+    {
+      cache->empty_count--;
+    }
+}
+
+// takes a page, lays out and constructs its objects, the slab is not on any list yet
+kma_slab_t*
+create_slab(kma_cache_t* cache)
+{
+  kma_page_t* page = get_page();
+  kma_slab_t* slab = SLAB_OF(page->ptr);
+  int i;
+
+  slab->page = page;
+  slab->cache = cache;
+  slab->in_use = 0;
+  slab->free_list = NULL;
+  slab->zero = page->zero && cache->ctor == NULL;
+
+  slab->color = cache->color_next;
+  cache->color_next += cache->color_step;
+  if (cache->color_next > cache->color_max)
+    {
+      cache->color_next = 0;
+    }
+
+  // build the free list backwards so objects are handed out in address order
+  for (i = cache->per_slab - 1; i >= 0; i--)
+    {
+      void* obj = (char*)page->ptr + slab->color + i * cache->stride;
+
+      if (cache->ctor != NULL)
+        {
+          cache->ctor(obj, cache->size);
+        }
+
+      LINK(cache, obj) = slab->free_list;
+      slab->free_list = obj;
+    }
+
+  return slab;
+}
+
+// destructs the objects of an empty slab (already off its list) and gives the page back
+void
+destroy_slab(kma_cache_t* cache, kma_slab_t* slab)
+{
+  assert(slab->in_use == 0);
+
+  if (cache->dtor != NULL)
+    {
+      void* obj;
+      for (obj = slab->free_list; obj != NULL; obj = LINK(cache, obj))
+        {
+          cache->dtor(obj, cache->size);
+        }
+    }
+
+  free_page(slab->page);
+}
+
+kma_cache_t*
+kma_cache_create(kma_size_t size, kma_size_t align,
+                 kma_cache_fn_t ctor, kma_cache_fn_t dtor)
+{
+  if (!gCacheCacheReady)
+    {
+      init_cache(&gCacheCache, sizeof(kma_cache_t), 0, NULL, NULL);
+      gCacheCacheReady = TRUE;
+    }
+
+  kma_cache_t* cache = kma_cache_alloc(&gCacheCache);
+
+  if (!init_cache(cache, size, align, ctor, dtor))
+    {
+      kma_cache_free(&gCacheCache, cache);
+      kma_cache_reap(&gCacheCache);
+      return NULL;
+    }
+
+  return cache;
+}
+
+// returns the slab the next object comes from, taken off its list
+kma_slab_t*
+alloc_slab(kma_cache_t* cache)
+{
+  kma_slab_t* slab = cache->partial;
+
+  if (slab == NULL)
+    {
+      slab = cache->empty;
+    }
+
+  if (slab != NULL)
+    {
+      unlink_slab(cache, slab);
+    }
+  else
+    {
+      slab = create_slab(cache);
+    }
+
+  return slab;
+}
+
+void*
+kma_cache_alloc(kma_cache_t* cache)
+{
+  kma_slab_t* slab = alloc_slab(cache);
+
+  void* obj = slab->free_list;
+  slab->free_list = LINK(cache, obj);
+  slab->in_use++;
+
+  link_slab(cache, slab);
+
+  return obj;
+}
+
+void*
+kma_cache_zalloc(kma_cache_t* cache)
+{
+  kma_slab_t* slab = alloc_slab(cache);
+
+  void* obj = slab->free_list;
+  slab->free_list = LINK(cache, obj);
+  slab->in_use++;
+
+  if (slab->zero)
+    {
+      LINK(cache, obj) = NULL;
+    }
+  else
+    {
+      memset(obj, 0, cache->size);
+    }
+
+  link_slab(cache, slab);
+
+  return obj;
+}
+
+void
+kma_cache_free(kma_cache_t* cache, void* obj)
+{
+  kma_slab_t* slab = SLAB_OF(obj);
+
+  unlink_slab(cache, slab);
+
+  LINK(cache, obj) = slab->free_list;
+  slab->free_list = obj;
+  slab->in_use--;
+  slab->zero = FALSE;
+
+  if (slab->in_use == 0 && cache->empty_count >= EMPTY_SLABS_KEPT)
+    {
+      destroy_slab(cache, slab);
+    }
+  else
+    {
+      link_slab(cache, slab);
+    }
+}
+
+void
+kma_cache_reap(kma_cache_t* cache)
+{
+  while (cache->empty != NULL)
+    {
+      kma_slab_t* slab = cache->empty;
+
+      unlink_slab(cache, slab);
+      destroy_slab(cache, slab);
+    }
+}
+
+void
+kma_cache_destroy(kma_cache_t* cache)
+{
+  assert(cache->full == NULL && cache->partial == NULL);
+
+  kma_cache_reap(cache);
+
+  kma_cache_free(&gCacheCache, cache);
+
+  // the last cache is gone, give back the descriptor page too
+  if (gCacheCache.full == NULL && gCacheCache.partial == NULL)
+    {
+      kma_cache_reap(&gCacheCache);
+    }
+}
+
+kma_cache_t*
+kma_cache_of(void* obj)
+{
+  if (PAGE_TAG(obj) & OWN_PAGE_BIT)
+    return NULL;
+
+  return SLAB_OF(obj)->cache;
+}
+
+kma_size_t
+kma_cache_size(kma_cache_t* cache)
+{
+  return cache->size;
+}
+
+void*
+kma_cache_page_alloc()
+{
+  kma_page_t* page = get_page();
+
+  assert(offsetof(kma_slab_t, cache) == sizeof(kma_slab_t) - sizeof(long));
+
+  PAGE_TAG(page->ptr) = (long)page | OWN_PAGE_BIT;
+
+  return page->ptr;
+}
+
+kma_page_t*
+kma_cache_page_of(void* obj)
+{
+  if (PAGE_TAG(obj) & OWN_PAGE_BIT)
+    return (kma_page_t*)(PAGE_TAG(obj) & ~OWN_PAGE_BIT);
+
+  return SLAB_OF(obj)->page;
+}
@@ -0,0 +1,167 @@
+/***************************************************************************
+ *  Title: Kernel Object Cache Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Interface for the slab object caches
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+
+#ifndef __KCACHE_H__
+#define __KCACHE_H__
+
+/************System include***********************************************/
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __KCACHE_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+typedef struct kma_cache kma_cache_t;
+
+// largest object a page of its own holds (kma_cache_page_alloc), a tag in the last
+// word of the page takes the rest
+#define KMA_CACHE_PAGE_MAX (PAGESIZE - (int)sizeof(long))
+
+// constructor/destructor of the objects of a cache, called with the object and the object size
+typedef void (*kma_cache_fn_t)(void*, kma_size_t);
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Creates an object cache
+ * ---------------------------------------------------------------------
+ *    Purpose: Creates a cache of objects of one size, carved out of
+ *             pages from get_page(). Objects are constructed once when
+ *             their slab is created and destructed when the slab is
+ *             given back, not on every alloc/free
+ *    Input: the object size, the object alignment (a power of 2, 0 for
+ *           the default of 8), the constructor and destructor (both
+ *           may be NULL)
+ *    Output: the cache or NULL if the objects can't fit in a page
+ ***********************************************************************/
+EXTERN kma_cache_t* kma_cache_create(kma_size_t size, kma_size_t align,
+                                     kma_cache_fn_t ctor, kma_cache_fn_t dtor);
+
+/***********************************************************************
+ *  Title: Allocates an object
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns a constructed object from the cache
+ *    Input: the cache
+ *    Output: the object
+ ***********************************************************************/
+EXTERN void* kma_cache_alloc(kma_cache_t* cache);
+
+/***********************************************************************
+ *  Title: Allocates a zeroed object
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns an object of the cache set to zero. Objects of
+ *             a slab whose page came zeroed are only cleared where
+ *             the free list link was, until one is freed back into
+ *             the slab
+ *    Input: the cache
+ *    Output: the object
+ ***********************************************************************/
+EXTERN void* kma_cache_zalloc(kma_cache_t* cache);
+
+/***********************************************************************
+ *  Title: Frees an object
+ * ---------------------------------------------------------------------
+ *    Purpose: Gives an object back to its cache. The object must be in
+ *             its constructed state again
+ *    Input: the cache, the object
+ *    Output: none
+ ***********************************************************************/
+EXTERN void kma_cache_free(kma_cache_t* cache, void* obj);
+
+/***********************************************************************
+ *  Title: Finds the cache of an object
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns the cache an object was allocated from, found
+ *             through the last word of its page
+ *    Input: the object
+ *    Output: the cache, NULL for the object of a page of its own
+ ***********************************************************************/
+EXTERN kma_cache_t* kma_cache_of(void* obj);
+
+/***********************************************************************
+ *  Title: Finds the object size of a cache
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns the size of the objects of a cache, as it was
+ *             created
+ *    Input: the cache
+ *    Output: the object size
+ ***********************************************************************/
+EXTERN kma_size_t kma_cache_size(kma_cache_t* cache);
+
+/***********************************************************************
+ *  Title: Allocates a page of its own
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns the start of a page from get_page() for an
+ *             object too large for a cache, up to KMA_CACHE_PAGE_MAX
+ *             bytes. The last word of the page, where a slab keeps
+ *             its cache, tags the page, so the object can be told
+ *             from the objects of a cache
+ *    Input: none
+ *    Output: the object
+ ***********************************************************************/
+EXTERN void* kma_cache_page_alloc();
+
+/***********************************************************************
+ *  Title: Finds the page of an object
+ * ---------------------------------------------------------------------
+ *    Purpose: Returns the page object of the page an object is on,
+ *             found through the last word of the page. It is
+ *             the one to hand back to free_page() for the object of
+ *             a page of its own
+ *    Input: the object
+ *    Output: the page object
+ ***********************************************************************/
+EXTERN kma_page_t* kma_cache_page_of(void* obj);
+
+/***********************************************************************
+ *  Title: Reaps a cache
+ * ---------------------------------------------------------------------
+ *    Purpose: Destructs the objects of every empty slab of the cache
+ *             and gives their pages back
+ *    Input: the cache
+ *    Output: none
+ ***********************************************************************/
+EXTERN void kma_cache_reap(kma_cache_t* cache);
+
+/***********************************************************************
+ *  Title: Destroys a cache
+ * ---------------------------------------------------------------------
+ *    Purpose: Reaps the cache and frees it. All of its objects must
+ *             have been freed
+ *    Input: the cache
+ *    Output: none
+ ***********************************************************************/
+EXTERN void kma_cache_destroy(kma_cache_t* cache);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __KCACHE_H__ */
@@ -0,0 +1,182 @@
+/***************************************************************************
+ *  Title: Kernel Object Cache Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Checks the constructor/destructor and coloring behaviour of
+ *             the slab object caches
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+
+/************System include***********************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+#include "kma_cache.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// 8 objects of 1000 bytes (plus the free list link) to a slab leave 80 bytes
+// of slack, so the slabs take the colors 0 and 64 in turn
+#define OBJ_SIZE 1000
+#define PER_SLAB 8
+#define OBJS 100
+
+#define CONSTRUCTED 0x5EED
+#define PATTERN 0xA5
+
+typedef struct
+{
+  int  state;                    // CONSTRUCTED between the ctor and the dtor
+  int  dtors;                    // number of times the dtor ran on this object
+  char fill[OBJ_SIZE - 2 * sizeof(int)];
+} object_t;
+
+/************Global Variables*********************************************/
+
+static int gCtors = 0;
+static int gDtors = 0;
+static int gFailures = 0;
+
+/************Function Prototypes******************************************/
+void ctor(void*, kma_size_t);
+void dtor(void*, kma_size_t);
+void check(int, char*);
+int color_of(void*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+int
+main(int argc, char* argv[])
+{
+  object_t* objs[OBJS];
+  int i, j;
+
+  kma_cache_t* cache = kma_cache_create(OBJ_SIZE, 0, ctor, dtor);
+  check(cache != NULL, "cache created");
+  check(kma_cache_size(cache) == OBJ_SIZE, "cache keeps its object size");
+
+  // every object comes constructed and keeps its state across free/alloc,
+  // since the free list link lives after the object
+  for (i = 0; i < OBJS; i++)
+    {
+      objs[i] = kma_cache_alloc(cache);
+      check(objs[i]->state == CONSTRUCTED, "object constructed");
+      check(kma_cache_of(objs[i]) == cache, "object found in its cache");
+    }
+  check(gCtors >= OBJS, "one ctor call per object");
+
+  // objects are handed out in address order, so a new page means a new slab.
+  // Successive slabs take different colors and the colors wrap around
+  int slabs = 0, colors[OBJS];
+  for (i = 0; i < OBJS; i++)
+    {
+      if (i == 0 || BASEADDR(objs[i]) != BASEADDR(objs[i - 1]))
+        {
+          colors[slabs++] = color_of(objs[i]);
+        }
+    }
+  check(slabs >= 3, "objects span several slabs");
+  for (i = 1; i < slabs; i++)
+    {
+      check(colors[i] != colors[i - 1], "successive slabs take different colors");
+      check(colors[i] % 64 == 0 && colors[i] <= 64, "colors stay within the slack");
+    }
+  check(colors[0] == colors[2], "colors wrap around");
+
+  for (i = 0; i < OBJS; i += 2)
+    {
+      kma_cache_free(cache, objs[i]);
+    }
+  for (i = 0; i < OBJS; i += 2)
+    {
+      objs[i] = kma_cache_alloc(cache);
+      check(objs[i]->state == CONSTRUCTED, "constructed state survives free/alloc");
+      for (j = 0; j < sizeof(objs[i]->fill); j++)
+        {
+          if ((unsigned char)objs[i]->fill[j] != PATTERN)
+            {
+              break;
+            }
+        }
+      check(j == sizeof(objs[i]->fill), "object contents survive free/alloc");
+    }
+
+  // the dtor runs exactly once per constructed object, whether the slab is
+  // given back by a free or by the reap
+  for (i = 0; i < OBJS; i++)
+    {
+      kma_cache_free(cache, objs[i]);
+    }
+  int kept = gCtors - gDtors;
+  check(kept == PER_SLAB, "one empty slab kept after the frees");
+  kma_cache_reap(cache);
+  check(gDtors == gCtors, "one dtor call per constructed object");
+  kma_cache_destroy(cache);
+
+  check(page_stats()->num_in_use == 0, "all pages given back");
+
+  printf("ctors %d, dtors %d, slabs %d\n", gCtors, gDtors, slabs);
+  printf("Test: %s\n", gFailures == 0 ? "PASS" : "FAIL");
+
+  return gFailures == 0 ? 0 : 1;
+}
+
+void
+ctor(void* obj, kma_size_t size)
+{
+  object_t* object = obj;
+
+  check(size == OBJ_SIZE, "ctor gets the object size");
+
+  object->state = CONSTRUCTED;
+  object->dtors = 0;
+  memset(object->fill, PATTERN, sizeof(object->fill));
+  gCtors++;
+}
+
+void
+dtor(void* obj, kma_size_t size)
+{
+  object_t* object = obj;
+
+  check(object->state == CONSTRUCTED, "dtor gets a constructed object");
+  check(object->dtors == 0, "dtor runs once per object");
+
+  object->dtors++;
+  gDtors++;
+}
+
+// offset of the first object of a slab from the start of its page
+int
+color_of(void* obj)
+{
+  return ((char*)obj - (char*)BASEADDR(obj)) % (OBJ_SIZE + sizeof(void*));
+}
+
+void
+check(int ok, char* what)
+{
+  if (!ok)
+    {
+      fprintf(stderr, "FAILED: %s\n", what);
+      gFailures++;
+    }
+}
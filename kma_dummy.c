@@ -46,6 +46,7 @@
 /************System include***********************************************/
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 /************Private include**********************************************/
 #include "kma_page.h"
@@ -96,9 +97,104 @@ void kma_free(void* ptr, kma_size_t size)
 {
   kma_page_t* page;
   
-  page = *((kma_page_t**)(ptr - sizeof(kma_page_t*)));
+  // the page structure is at the beginning of the page, wherever the
+  // request starts in it
+  page = *((kma_page_t**)BASEADDR(ptr));
   
   free_page(page);
 }
 
+void kma_free_unsized(void* ptr)
+{
+  // the size was never needed
+  kma_free(ptr, 0);
+}
+
+kma_size_t kma_usable_size(void* ptr)
+{
+  // the request has the rest of its page
+  return PAGESIZE - (ptr - BASEADDR(ptr));
+}
+
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  void* new_ptr;
+
+  // every request has a page of its own, which is large enough unless the
+  // request was aligned and starts further in. It moves to the start of a
+  // new page then, or can't be served at all
+  if (new_size <= PAGESIZE - (ptr - BASEADDR(ptr)))
+    {
+      return ptr;
+    }
+
+  new_ptr = kma_malloc(new_size);
+  if (new_ptr == NULL)
+    {
+      return NULL;
+    }
+
+  memcpy(new_ptr, ptr, old_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  kma_page_t* page;
+
+  if (alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    {
+      return NULL;
+    }
+
+  if (alignment <= sizeof(kma_page_t*))
+    {
+      return kma_malloc(size);
+    }
+
+  // pages are aligned to their size, so the request starts at the
+  // alignment, past the pointer to the page structure
+  if (alignment + size > PAGESIZE)
+    {
+      return NULL;
+    }
+
+  page = get_page();
+  *((kma_page_t**)page->ptr) = page;
+
+  return page->ptr + alignment;
+}
+
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+  kma_page_t* page;
+  void* ptr;
+
+  // nothing is zeroed for a count or size below 1, and no request fits in
+  // more than a page, which together keep count * size from overflowing
+  if (count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    {
+      return NULL;
+    }
+
+  size *= count;
+  ptr = kma_malloc(size);
+  if (ptr == NULL)
+    {
+      return NULL;
+    }
+
+  // a page that came zeroed only has the pointer to the page structure
+  // written to it
+  page = *((kma_page_t**)BASEADDR(ptr));
+  if (!page->zero)
+    {
+      memset(ptr, 0, size);
+    }
+
+  return ptr;
+}
+
 #endif // KMA_DUMMY
@@ -0,0 +1,600 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Kernel memory allocator with per-thread heaps of superblocks
+ *             and a global heap (Hoard)
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.2  2009/10/31 21:28:52  jot836
+ *    This is the current version of KMA project 3.
+ *    It includes:
+ *    - the most up-to-date handout (F'09)
+ *    - updated skeleton including
+ *        file-driven test harness,
+ *        trace generator script,
+ *        support for evaluating efficiency of algorithm (wasted memory),
+ *        gnuplot support for plotting allocation and waste,
+ *        set of traces for all students to use (including a makefile and README of the settings),
+ *    - different version of the testsuite for use on the submission site, including:
+ *        scoreboard Python scripts, which posts the top 5 scores on the course webpage
+ *
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ *    Revision 1.2  2004/11/05 15:45:56  sbirrer
+ *    - added size as a parameter to kma_free
+ *
+ *    Revision 1.1  2004/11/03 23:04:03  sbirrer
+ *    - initial version for the kernel memory allocator project
+ *
+ ***************************************************************************/
+#ifdef KMA_HOARD
+#define __KMA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+ //size classes are 16 byte steps up to 128, then 4 classes per power of 2 up to 896,
+ //then the largest sizes that fit 7, 6, 5, 4, 3 and 2 blocks in a superblock
+ #define QUANTUM 16
+ #define QUANTUM_MAX 128
+ #define QUARTER_MAX 896
+ #define QUARTER_CLASSES 19
+ #define NUM_CLASSES 25
+
+ //largest size class, requests above it get a page of their own. A multiple of a cache line
+ //(4048 would fit too), so that kma_memalign has a class for 64 byte aligned requests up to it
+ #define SMALL_MAX 4032
+
+ //a page of its own has its page object in the first word like a superblock, with the lowest
+ //bit set so kma_free_unsized can tell them apart (page objects come from malloc)
+ #define BIG_PAGE_BIT 1L
+ #define IS_BIG_PAGE(ptr) (*(long*)BASEADDR(ptr) & BIG_PAGE_BIT)
+ #define BIG_PAGE_OF(ptr) ((kma_page_t*)(*(long*)BASEADDR(ptr) & ~BIG_PAGE_BIT))
+
+ //the superblocks of a class are kept on FULLNESS_GROUPS lists by how full they are
+ //(0-25%, 25-50%, ...), and full ones on one more list
+ #define FULLNESS_GROUPS 4
+ #define FULL_GROUP FULLNESS_GROUPS
+
+ //a thread heap hands a superblock to the global heap once less than 1 - 1/EMPTY_FRACTION
+ //of what it holds is in use and more than SLACK_SUPERBLOCKS superblocks' worth is free
+ #define EMPTY_FRACTION 4
+ #define SLACK_SUPERBLOCKS 4
+
+ //most thread heaps there can be, twice the number of processors are used
+ #define MAX_HEAPS 32
+
+typedef struct hoard_block hoard_block;
+
+//a free block, the link is all it holds
+struct hoard_block
+{
+  hoard_block* next;
+};
+
+typedef struct hoard_heap hoard_heap;
+typedef struct hoard_superblock hoard_superblock;
+
+//a superblock is one page of blocks of a single class. This header sits at the start
+//of the page, the blocks follow it
+struct hoard_superblock
+{
+  kma_page_t* page;//the page object to hand back to free_page
+  hoard_heap* owner;//changes only with both the owner's and the global heap's lock held
+  hoard_superblock* prev;//neighbours on the owner's list for the class and fullness group
+  hoard_superblock* next;
+  hoard_block* free;
+  int used;//blocks handed out
+  int capacity;//number of blocks of the superblock
+  int class;
+  int group;//fullness group the superblock is listed under
+  bool zero;//the blocks on the free list hold only zeros but for their links (the page came
+            //zeroed and no block was freed back yet)
+};
+
+ #define CACHE_LINE 64
+
+ //offset of the first block of a superblock, a whole number of cache lines (the header is
+ //one) so that the blocks of a class are aligned to up to a cache line if its size is
+ #define SUPERBLOCK_HEADER ((sizeof(hoard_superblock) + CACHE_LINE - 1) & ~(CACHE_LINE - 1))
+
+//a cache line of its own for every heap, so threads on different heaps share no lines
+struct hoard_heap
+{
+  pthread_mutex_t lock;
+  hoard_superblock* groups[NUM_CLASSES][FULLNESS_GROUPS + 1];
+  long in_use;//bytes of the blocks handed out (u in the Hoard paper)
+  long held;//bytes of the superblocks held (a in the Hoard paper)
+} __attribute__((aligned(64)));
+
+/************Global Variables*********************************************/
+
+//block size of every class
+static const int kClassSize[NUM_CLASSES] = {
+	  16,   32,   48,   64,   80,   96,  112,  128,
+	 160,  192,  224,  256,  320,  384,  448,  512,
+	 640,  768,  896, 1152, 1344, 1616, 2016, 2688,
+	4032 };
+
+static hoard_heap gHeaps[MAX_HEAPS];
+static int gHeapCount;
+
+//superblocks thread heaps gave up, any heap takes them back before it takes a new page
+static hoard_heap gGlobalHeap;
+
+static pthread_once_t gHeapsOnce = PTHREAD_ONCE_INIT;
+
+//threads are handed heaps round robin
+static int gNextHeap = 0;
+static __thread hoard_heap* gMyHeap = NULL;
+
+//get_page and free_page are not thread safe
+static pthread_mutex_t gPageLock = PTHREAD_MUTEX_INITIALIZER;
+
+/************Function Prototypes******************************************/
+int size_class(kma_size_t size);
+void init_heaps();
+hoard_heap* my_heap();
+kma_page_t* lock_get_page();
+void lock_free_page(kma_page_t* page);
+void link_superblock(hoard_heap* heap, hoard_superblock* sb);
+void unlink_superblock(hoard_heap* heap, hoard_superblock* sb);
+void regroup(hoard_heap* heap, hoard_superblock* sb);
+void add_superblock(hoard_heap* heap, hoard_superblock* sb);
+void remove_superblock(hoard_heap* heap, hoard_superblock* sb);
+hoard_superblock* new_superblock(int class);
+hoard_superblock* take_from_global(hoard_heap* heap, int class);
+void keep_invariant(hoard_heap* heap, int class);
+hoard_heap* lock_owner(hoard_superblock* sb);
+void* big_malloc(kma_size_t size);
+void* big_memalign(kma_size_t alignment, kma_size_t size);
+void free_block(void* ptr);
+void* class_malloc(int class, bool* zero);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+//size class of a request of at most SMALL_MAX bytes
+int size_class(kma_size_t size)
+{
+  if(size <= QUANTUM_MAX)
+    return (size <= 0) ? 0 : (size - 1) / QUANTUM;
+
+  if(size <= QUARTER_MAX){
+    //the top 3 bits of size - 1 pick the power of 2 and the quarter within it
+    int x = size - 1;
+    int log2 = 31 - __builtin_clz(x);
+
+    return QUANTUM_MAX / QUANTUM + (log2 - 7) * 4 + (x >> (log2 - 2)) - 4;
+  }
+
+  int class = QUARTER_CLASSES;
+  while(kClassSize[class] < size)
+    class++;
+
+  return class;
+}
+
+void init_heaps()
+{
+  int i;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  gHeapCount = (cpus < 1) ? 2 : 2 * cpus;
+  if(gHeapCount > MAX_HEAPS)
+    gHeapCount = MAX_HEAPS;
+
+  for(i = 0; i < gHeapCount; i++)
+    pthread_mutex_init(&gHeaps[i].lock, NULL);
+
+  pthread_mutex_init(&gGlobalHeap.lock, NULL);
+}
+
+//the heap of the calling thread
+hoard_heap* my_heap()
+{
+  if(gMyHeap == NULL){
+    pthread_once(&gHeapsOnce, init_heaps);
+    gMyHeap = &gHeaps[__atomic_fetch_add(&gNextHeap, 1, __ATOMIC_RELAXED) % gHeapCount];
+  }
+
+  return gMyHeap;
+}
+
+kma_page_t* lock_get_page()
+{
+  pthread_mutex_lock(&gPageLock);
+  kma_page_t* page = get_page();
+  pthread_mutex_unlock(&gPageLock);
+
+  return page;
+}
+
+void lock_free_page(kma_page_t* page)
+{
+  pthread_mutex_lock(&gPageLock);
+  free_page(page);
+  pthread_mutex_unlock(&gPageLock);
+}
+
+//puts a superblock on the list of its fullness group
+void link_superblock(hoard_heap* heap, hoard_superblock* sb)
+{
+  hoard_superblock** head;
+
+  sb->group = (sb->used == sb->capacity) ? FULL_GROUP : sb->used * FULLNESS_GROUPS / sb->capacity;
+  head = &heap->groups[sb->class][sb->group];
+
+  sb->prev = NULL;
+  sb->next = *head;
+  if(*head != NULL)
+    (*head)->prev = sb;
+  *head = sb;
+}
+
+void unlink_superblock(hoard_heap* heap, hoard_superblock* sb)
+{
+  if(sb->prev != NULL)
+    sb->prev->next = sb->next;
+  else
+    heap->groups[sb->class][sb->group] = sb->next;
+
+  if(sb->next != NULL)
+    sb->next->prev = sb->prev;
+}
+
+//moves a superblock to another list if its fullness group changed
+void regroup(hoard_heap* heap, hoard_superblock* sb)
+{
+  int group = (sb->used == sb->capacity) ? FULL_GROUP : sb->used * FULLNESS_GROUPS / sb->capacity;
+
+  if(group != sb->group){
+    unlink_superblock(heap, sb);
+    link_superblock(heap, sb);
+  }
+}
+
+//the caller sets the owner
+void add_superblock(hoard_heap* heap, hoard_superblock* sb)
+{
+  link_superblock(heap, sb);
+  heap->held += PAGESIZE;
+  heap->in_use += sb->used * kClassSize[sb->class];
+}
+
+void remove_superblock(hoard_heap* heap, hoard_superblock* sb)
+{
+  unlink_superblock(heap, sb);
+  heap->held -= PAGESIZE;
+  heap->in_use -= sb->used * kClassSize[sb->class];
+}
+
+//takes a new page and threads all of its blocks on the free list
+hoard_superblock* new_superblock(int class)
+{
+  kma_page_t* page = lock_get_page();
+  hoard_superblock* sb = (hoard_superblock*)page->ptr;
+  int size = kClassSize[class];
+  int i;
+
+  sb->page = page;
+  sb->used = 0;
+  sb->capacity = (PAGESIZE - SUPERBLOCK_HEADER) / size;
+  sb->class = class;
+  sb->zero = page->zero;
+
+  //built backwards so blocks are handed out in address order
+  sb->free = NULL;
+  for(i = sb->capacity - 1; i >= 0; i--){
+    hoard_block* block = (hoard_block*)((char*)sb + SUPERBLOCK_HEADER + i * size);
+
+    block->next = sb->free;
+    sb->free = block;
+  }
+
+  return sb;
+}
+
+//moves the fullest superblock of the class from the global heap to heap (whose lock is held),
+//NULL if the global heap has none
+hoard_superblock* take_from_global(hoard_heap* heap, int class)
+{
+  hoard_superblock* sb = NULL;
+  int group;
+
+  pthread_mutex_lock(&gGlobalHeap.lock);
+
+  //the global heap only holds superblocks with free blocks
+  for(group = FULLNESS_GROUPS - 1; group >= 0 && sb == NULL; group--)
+    sb = gGlobalHeap.groups[class][group];
+
+  if(sb != NULL){
+    remove_superblock(&gGlobalHeap, sb);
+    __atomic_store_n(&sb->owner, heap, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&gGlobalHeap.lock);
+
+  return sb;
+}
+
+//Hoard's emptiness invariant: when a thread heap holds much more than it uses, its emptiest
+//superblock (one at least 1/EMPTY_FRACTION free) goes to the global heap where other threads
+//can take it. This bounds the memory a thread can hold on to after freeing. Called with the
+//heap's lock held, after a free of the class
+void keep_invariant(hoard_heap* heap, int class)
+{
+  if(heap->in_use >= heap->held - SLACK_SUPERBLOCKS * PAGESIZE
+     || heap->in_use * EMPTY_FRACTION >= heap->held * (EMPTY_FRACTION - 1))
+    return;
+
+  //look at the class just freed into first, it most likely has one
+  hoard_superblock* sb = NULL;
+  int i, group;
+
+  for(i = 0; i < NUM_CLASSES && sb == NULL; i++){
+    int c = (class + i) % NUM_CLASSES;
+
+    for(group = 0; group < FULLNESS_GROUPS - 1 && sb == NULL; group++)
+      sb = heap->groups[c][group];
+  }
+
+  if(sb == NULL)
+    return;
+
+  pthread_mutex_lock(&gGlobalHeap.lock);
+
+  remove_superblock(heap, sb);
+  __atomic_store_n(&sb->owner, &gGlobalHeap, __ATOMIC_RELEASE);
+  add_superblock(&gGlobalHeap, sb);
+
+  pthread_mutex_unlock(&gGlobalHeap.lock);
+}
+
+//locks the heap that owns a superblock. The owner may change until its lock is held
+hoard_heap* lock_owner(hoard_superblock* sb)
+{
+  for(;;){
+    hoard_heap* heap = __atomic_load_n(&sb->owner, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&heap->lock);
+    if(__atomic_load_n(&sb->owner, __ATOMIC_RELAXED) == heap)
+      return heap;
+    pthread_mutex_unlock(&heap->lock);
+  }
+}
+
+//requests above SMALL_MAX get a page of their own, the page object goes in front
+void* big_malloc(kma_size_t size)
+{
+  if(size > PAGESIZE - (int)sizeof(kma_page_t*))
+    return NULL;
+
+  kma_page_t* page = lock_get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + sizeof(kma_page_t*);
+}
+
+//a page of its own with the payload at the alignment and the page object in front, for large
+//aligned requests and for small ones no block can be aligned for
+void* big_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(size > PAGESIZE - (int)alignment)
+    return NULL;
+
+  kma_page_t* page = lock_get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + alignment;
+}
+
+void* kma_malloc(kma_size_t size)
+{
+  if(size > SMALL_MAX)
+    return big_malloc(size);
+
+  return class_malloc(size_class(size), NULL);
+}
+
+//sets *zero (if not NULL) when the block is zero but for its link
+void* class_malloc(int class, bool* zero)
+{
+  hoard_heap* heap = my_heap();
+  hoard_superblock* sb = NULL;
+  int group;
+
+  pthread_mutex_lock(&heap->lock);
+
+  //the fullest superblock with a free block, which lets the emptier ones drain
+  for(group = FULLNESS_GROUPS - 1; group >= 0 && sb == NULL; group--)
+    sb = heap->groups[class][group];
+
+  if(sb == NULL){
+    sb = take_from_global(heap, class);
+
+    if(sb == NULL){
+      sb = new_superblock(class);
+      sb->owner = heap;
+    }
+
+    add_superblock(heap, sb);
+  }
+
+  hoard_block* block = sb->free;
+
+  sb->free = block->next;
+  sb->used++;
+  heap->in_use += kClassSize[class];
+  regroup(heap, sb);
+
+  if(zero != NULL)
+    *zero = sb->zero;
+
+  pthread_mutex_unlock(&heap->lock);
+
+  return block;
+}
+
+//gives a block back to its superblock, under the lock of the heap that owns it
+void free_block(void* ptr)
+{
+  hoard_superblock* sb = (hoard_superblock*)BASEADDR(ptr);
+  hoard_heap* heap = lock_owner(sb);
+  hoard_block* block = ptr;
+  int class = sb->class;
+
+  block->next = sb->free;
+  sb->free = block;
+  sb->used--;
+  sb->zero = FALSE;
+  heap->in_use -= kClassSize[class];
+
+  //an empty superblock goes straight back to the page allocator, where a superblock of
+  //any class can be made from it
+  if(sb->used == 0){
+    remove_superblock(heap, sb);
+    lock_free_page(sb->page);
+  }else{
+    regroup(heap, sb);
+  }
+
+  if(heap != &gGlobalHeap)
+    keep_invariant(heap, class);
+
+  pthread_mutex_unlock(&heap->lock);
+}
+
+//a small block of kma_memalign can have a page of its own too
+void kma_free(void* ptr, kma_size_t size)
+{
+  if(size > SMALL_MAX || IS_BIG_PAGE(ptr))
+    lock_free_page(BIG_PAGE_OF(ptr));
+  else
+    free_block(ptr);
+}
+
+//the superblock has the class, a page of its own is told apart by the bit in its first word
+void kma_free_unsized(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    lock_free_page(BIG_PAGE_OF(ptr));
+  else
+    free_block(ptr);
+}
+
+//a superblock keeps its class until it is given back, which it isn't while a block of it is used
+kma_size_t kma_usable_size(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    return PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr));
+
+  return kClassSize[((hoard_superblock*)BASEADDR(ptr))->class];
+}
+
+//a block stays where it is if the new size is of the same class, otherwise it is copied
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  bool big = IS_BIG_PAGE(ptr);
+
+  //the payload of a page of its own starts further in if it was aligned
+  if(big && new_size > SMALL_MAX && new_size <= PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr)))
+    return ptr;
+
+  if(!big && new_size <= SMALL_MAX && size_class(old_size) == size_class(new_size))
+    return ptr;
+
+  void* new_ptr = kma_malloc(new_size);
+  if(new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+//an aligned block comes from the smallest class whose blocks are all aligned, kma_free finds
+//the class in the superblock header as it does for any block
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+
+  if(alignment <= 8)
+    return kma_malloc(size);
+
+  if(size > SMALL_MAX)
+    return big_memalign(alignment, size);
+
+  //no block is aligned to more than the first one of its superblock, and no class may be a
+  //multiple of the alignment. Such a block gets a page of its own
+  if(SUPERBLOCK_HEADER % alignment != 0)
+    return big_memalign(alignment, size);
+
+  int class = size_class(size);
+  while(class < NUM_CLASSES && kClassSize[class] % alignment != 0)
+    class++;
+
+  if(class == NUM_CLASSES)
+    return big_memalign(alignment, size);
+
+  return class_malloc(class, NULL);
+}
+
+//a block from a superblock whose page came zeroed is still zero but for its link, as long as
+//only blocks that were never handed out are on its free list
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+  //nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+  //which together keep count * size from overflowing
+  if(count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    return NULL;
+
+  size *= count;
+
+  if(size > SMALL_MAX){
+    void* ptr = big_malloc(size);
+
+    if(ptr != NULL && !BIG_PAGE_OF(ptr)->zero)
+      memset(ptr, 0, size);
+
+    return ptr;
+  }
+
+  int class = size_class(size);
+  bool zero;
+  hoard_block* block = class_malloc(class, &zero);
+
+  //the whole block is cleared: gcc turns a memset of a size it knows is small into rep stos,
+  //which is slow for small blocks
+  if(zero)
+    block->next = NULL;
+  else
+    memset(block, 0, kClassSize[class]);
+
+  return block;
+}
+
+#endif // KMA_HOARD
@@ -70,4 +70,34 @@ kma_free(void* ptr, kma_size_t size)
   ;
 }
 
+void
+kma_free_unsized(void* ptr)
+{
+  ;
+}
+
+kma_size_t
+kma_usable_size(void* ptr)
+{
+  return 0;
+}
+
+void*
+kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  return NULL;
+}
+
+void*
+kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  return NULL;
+}
+
+void*
+kma_calloc(kma_size_t count, kma_size_t size)
+{
+  return NULL;
+}
+
 #endif // KMA_LZBUD
@@ -0,0 +1,625 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Per-thread magazine and depot layer in front of any kernel
+ *             memory allocator
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+#ifdef KMA_MAGAZINE
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+#include "kma_cache.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// sizes are rounded up to a multiple of MAG_GRANULE, one class per multiple
+#define MAG_GRANULE 16
+
+// largest request that goes through the magazines, larger ones go straight to the backend
+#define MAG_MAX 512
+
+#define MAG_CLASSES (MAG_MAX / MAG_GRANULE)
+
+// number of objects a magazine holds
+#define MAG_ROUNDS 15
+
+// number of full magazines the depot keeps of a class, the objects of any more
+// go back to the backend
+#define DEPOT_FULL_MAX 8
+
+typedef struct magazine magazine_t;
+
+// a stack of free objects of one size class
+struct magazine
+{
+  magazine_t*  next;                // next magazine on a depot list
+  int          rounds;              // number of objects in objs
+  void*        objs[MAG_ROUNDS];
+};
+
+// the magazines a thread allocates from and frees to
+typedef struct
+{
+  magazine_t*  loaded[MAG_CLASSES];   // the one used first
+  magazine_t*  previous[MAG_CLASSES]; // always full or empty
+} magazine_cpu_t;
+
+// full and empty magazines shared by all threads
+typedef struct
+{
+  magazine_t*  full[MAG_CLASSES];
+  magazine_t*  empty[MAG_CLASSES];
+  int          full_count[MAG_CLASSES]; // number of magazines on full
+} magazine_depot_t;
+
+/************Global Variables*********************************************/
+
+static __thread magazine_cpu_t gCpu;
+
+// true once this thread has asked to hand back its magazines when it exits
+static __thread bool gCpuRegistered = FALSE;
+
+static pthread_key_t gCpuKey;
+static pthread_once_t gCpuKeyOnce = PTHREAD_ONCE_INIT;
+
+static magazine_depot_t gDepot;
+
+// protects gDepot, taken before gBackendLock when both are needed
+static pthread_mutex_t gDepotLock = PTHREAD_MUTEX_INITIALIZER;
+
+// the backend, the magazine cache and the page layer under them are not
+// thread safe, only one thread at a time goes into them
+static pthread_mutex_t gBackendLock = PTHREAD_MUTEX_INITIALIZER;
+
+// the magazines themselves come from an object cache
+static kma_cache_t* gMagazineCache = NULL;
+
+// number of magazines taken from gMagazineCache
+static int gMagazineCount = 0;
+
+// number of objects handed out and not freed yet, with or without the magazines
+static int gLiveObjects = 0;
+
+/************Function Prototypes******************************************/
+void* kma_backend_malloc(kma_size_t size);
+void kma_backend_free(void* ptr, kma_size_t size);
+void kma_backend_free_unsized(void* ptr);
+kma_size_t kma_backend_usable_size(void* ptr);
+void* kma_backend_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size);
+void* kma_backend_memalign(kma_size_t alignment, kma_size_t size);
+void* kma_backend_calloc(kma_size_t count, kma_size_t size);
+magazine_t* magazine_new();
+void magazine_free(magazine_t* mag);
+void* magazine_refill(int class);
+void magazine_exchange(int class, void* ptr);
+void magazine_return();
+void magazine_flush();
+void magazine_register();
+void object_freed();
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+void*
+backend_malloc(kma_size_t size)
+{
+  pthread_mutex_lock(&gBackendLock);
+  void* ptr = kma_backend_malloc(size);
+  pthread_mutex_unlock(&gBackendLock);
+
+  return ptr;
+}
+
+void
+backend_free(void* ptr, kma_size_t size)
+{
+  pthread_mutex_lock(&gBackendLock);
+  kma_backend_free(ptr, size);
+  pthread_mutex_unlock(&gBackendLock);
+}
+
+// returns an empty magazine, must be called with the depot lock held
+magazine_t*
+magazine_new()
+{
+  pthread_mutex_lock(&gBackendLock);
+
+  if (gMagazineCache == NULL)
+    {
+      gMagazineCache = kma_cache_create(sizeof(magazine_t), 0, NULL, NULL);
+    }
+
+  magazine_t* mag = kma_cache_alloc(gMagazineCache);
+  gMagazineCount++;
+
+  pthread_mutex_unlock(&gBackendLock);
+
+  mag->next = NULL;
+  mag->rounds = 0;
+
+  return mag;
+}
+
+// loaded and previous are both empty: trade the empty previous for a full one
+// from the depot, or go to the backend if the depot has none
+void*
+magazine_refill(int class)
+{
+  magazine_t* full;
+
+  magazine_register();
+
+  pthread_mutex_lock(&gDepotLock);
+
+  full = gDepot.full[class];
+  if (full != NULL)
+    {
+      gDepot.full[class] = full->next;
+      gDepot.full_count[class]--;
+
+      if (gCpu.previous[class] != NULL)
+        {
+          gCpu.previous[class]->next = gDepot.empty[class];
+          gDepot.empty[class] = gCpu.previous[class];
+        }
+      gCpu.previous[class] = gCpu.loaded[class];
+      gCpu.loaded[class] = full;
+    }
+
+  pthread_mutex_unlock(&gDepotLock);
+
+  if (full == NULL)
+    {
+      return backend_malloc((class + 1) * MAG_GRANULE);
+    }
+
+  magazine_t* loaded = gCpu.loaded[class];
+  return loaded->objs[--loaded->rounds];
+}
+
+// loaded and previous are both full: trade the full previous for an empty one
+// from the depot (a new one if the depot has none), then keep ptr in it. If the
+// depot has enough full magazines of the class, the objects of previous go back
+// to the backend instead and it is reused. Objects freed without their size go
+// to the class of their usable size, which can be above the one they were
+// allocated for, so a class can get more objects back than it hands out
+void
+magazine_exchange(int class, void* ptr)
+{
+  magazine_t* empty;
+  magazine_t* full = gCpu.previous[class];
+
+  magazine_register();
+
+  pthread_mutex_lock(&gDepotLock);
+
+  if (full != NULL && gDepot.full_count[class] >= DEPOT_FULL_MAX)
+    {
+      pthread_mutex_lock(&gBackendLock);
+      while (full->rounds > 0)
+        {
+          kma_backend_free_unsized(full->objs[--full->rounds]);
+        }
+      pthread_mutex_unlock(&gBackendLock);
+
+      empty = full;
+    }
+  else
+    {
+      empty = gDepot.empty[class];
+      if (empty != NULL)
+        {
+          gDepot.empty[class] = empty->next;
+        }
+      else
+        {
+          empty = magazine_new();
+        }
+
+      if (full != NULL)
+        {
+          full->next = gDepot.full[class];
+          gDepot.full[class] = full;
+          gDepot.full_count[class]++;
+        }
+    }
+  gCpu.previous[class] = gCpu.loaded[class];
+  gCpu.loaded[class] = empty;
+
+  pthread_mutex_unlock(&gDepotLock);
+
+  empty->objs[empty->rounds++] = ptr;
+}
+
+// returns a magazine to the magazine cache, must be called with both locks held
+void
+magazine_free(magazine_t* mag)
+{
+  kma_cache_free(gMagazineCache, mag);
+  gMagazineCount--;
+}
+
+// puts this thread's magazines on the depot lists, those with objects on the
+// full lists, must be called with the depot lock held
+void
+magazine_return()
+{
+  int class, i;
+
+  for (class = 0; class < MAG_CLASSES; class++)
+    {
+      magazine_t* mags[2] = { gCpu.loaded[class], gCpu.previous[class] };
+
+      gCpu.loaded[class] = NULL;
+      gCpu.previous[class] = NULL;
+
+      for (i = 0; i < 2; i++)
+        {
+          if (mags[i] == NULL)
+            {
+              continue;
+            }
+
+          // a partly used one is fine on the full list, refill only needs rounds > 0
+          magazine_t** list = mags[i]->rounds > 0 ? &gDepot.full[class] : &gDepot.empty[class];
+
+          mags[i]->next = *list;
+          *list = mags[i];
+
+          if (mags[i]->rounds > 0)
+            {
+              gDepot.full_count[class]++;
+            }
+        }
+    }
+}
+
+// gives back the objects in this thread's magazines and in the depot to the
+// backend, then the magazines themselves. Magazines loaded by other threads
+// stay where they are. An object freed without its size may be larger than its
+// class, so the backend finds the size of each object itself
+void
+magazine_flush()
+{
+  int class;
+
+  pthread_mutex_lock(&gDepotLock);
+  pthread_mutex_lock(&gBackendLock);
+
+  magazine_return();
+
+  for (class = 0; class < MAG_CLASSES; class++)
+    {
+      while (gDepot.full[class] != NULL)
+        {
+          magazine_t* mag = gDepot.full[class];
+          gDepot.full[class] = mag->next;
+          gDepot.full_count[class]--;
+
+          while (mag->rounds > 0)
+            {
+              kma_backend_free_unsized(mag->objs[--mag->rounds]);
+            }
+          magazine_free(mag);
+        }
+
+      while (gDepot.empty[class] != NULL)
+        {
+          magazine_t* mag = gDepot.empty[class];
+          gDepot.empty[class] = mag->next;
+
+          magazine_free(mag);
+        }
+    }
+
+  if (gMagazineCache != NULL && gMagazineCount == 0)
+    {
+      kma_cache_destroy(gMagazineCache);
+      gMagazineCache = NULL;
+    }
+
+  pthread_mutex_unlock(&gBackendLock);
+  pthread_mutex_unlock(&gDepotLock);
+}
+
+// thread exit: this thread's magazines go to the depot. If nothing is in use
+// any more the depot is flushed as well
+void
+magazine_thread_exit(void* unused)
+{
+  pthread_mutex_lock(&gDepotLock);
+  magazine_return();
+  pthread_mutex_unlock(&gDepotLock);
+
+  if (__sync_add_and_fetch(&gLiveObjects, 0) == 0)
+    {
+      magazine_flush();
+    }
+}
+
+void
+magazine_make_key()
+{
+  pthread_key_create(&gCpuKey, magazine_thread_exit);
+}
+
+// makes sure magazine_thread_exit runs when this thread exits
+void
+magazine_register()
+{
+  if (gCpuRegistered)
+    {
+      return;
+    }
+
+  pthread_once(&gCpuKeyOnce, magazine_make_key);
+  pthread_setspecific(gCpuKey, &gCpu);
+  gCpuRegistered = TRUE;
+}
+
+// one object less is in use, if that was the last one let the backend give
+// its pages back
+void
+object_freed()
+{
+  if (__sync_sub_and_fetch(&gLiveObjects, 1) == 0)
+    {
+      magazine_flush();
+    }
+}
+
+void*
+kma_malloc(kma_size_t size)
+{
+  if (size <= 0 || size > MAG_MAX)
+    {
+      void* ptr = backend_malloc(size);
+      if (ptr != NULL)
+        {
+          __sync_add_and_fetch(&gLiveObjects, 1);
+        }
+
+      return ptr;
+    }
+
+  int class = (size - 1) / MAG_GRANULE;
+  void* ptr;
+
+  __sync_add_and_fetch(&gLiveObjects, 1);
+
+  magazine_t* loaded = gCpu.loaded[class];
+
+  if (loaded != NULL && loaded->rounds > 0)
+    {
+      return loaded->objs[--loaded->rounds];
+    }
+
+  // previous is either full or empty, a full one becomes the loaded one
+  magazine_t* previous = gCpu.previous[class];
+
+  if (previous != NULL && previous->rounds > 0)
+    {
+      gCpu.previous[class] = loaded;
+      gCpu.loaded[class] = previous;
+
+      return previous->objs[--previous->rounds];
+    }
+
+  ptr = magazine_refill(class);
+  if (ptr == NULL)
+    {
+      __sync_sub_and_fetch(&gLiveObjects, 1);
+    }
+
+  return ptr;
+}
+
+void
+kma_free(void* ptr, kma_size_t size)
+{
+  if (size <= 0 || size > MAG_MAX)
+    {
+      backend_free(ptr, size);
+      object_freed();
+      return;
+    }
+
+  int class = (size - 1) / MAG_GRANULE;
+
+  magazine_t* loaded = gCpu.loaded[class];
+
+  if (loaded != NULL && loaded->rounds < MAG_ROUNDS)
+    {
+      loaded->objs[loaded->rounds++] = ptr;
+    }
+  else
+    {
+      // previous is either full or empty, an empty one becomes the loaded one
+      magazine_t* previous = gCpu.previous[class];
+
+      if (previous != NULL && previous->rounds == 0)
+        {
+          gCpu.previous[class] = loaded;
+          gCpu.loaded[class] = previous;
+
+          previous->objs[previous->rounds++] = ptr;
+        }
+      else
+        {
+          magazine_exchange(class, ptr);
+        }
+    }
+
+  object_freed();
+}
+
+// an object freed without its size goes into the largest class its usable size
+// can serve, which may be below the class it was allocated from. The backend
+// reads the usable size without its lock
+void
+kma_free_unsized(void* ptr)
+{
+  kma_size_t size = kma_backend_usable_size(ptr);
+
+  if (size < MAG_GRANULE || size > MAG_MAX)
+    {
+      pthread_mutex_lock(&gBackendLock);
+      kma_backend_free_unsized(ptr);
+      pthread_mutex_unlock(&gBackendLock);
+
+      object_freed();
+      return;
+    }
+
+  kma_free(ptr, size / MAG_GRANULE * MAG_GRANULE);
+}
+
+// an object is as large as the backend made it, whatever class it is in
+kma_size_t
+kma_usable_size(void* ptr)
+{
+  return kma_backend_usable_size(ptr);
+}
+
+void*
+kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  // the object is as large as its magazine class
+  if (old_size > 0 && old_size <= MAG_MAX && new_size > 0 && new_size <= MAG_MAX
+      && (old_size - 1) / MAG_GRANULE == (new_size - 1) / MAG_GRANULE)
+    {
+      return ptr;
+    }
+
+  // neither size goes through the magazines, the backend may resize it in place
+  if (old_size > MAG_MAX && new_size > MAG_MAX)
+    {
+      pthread_mutex_lock(&gBackendLock);
+      void* new_ptr = kma_backend_realloc(ptr, old_size, new_size);
+      pthread_mutex_unlock(&gBackendLock);
+
+      return new_ptr;
+    }
+
+  void* new_ptr = kma_malloc(new_size);
+  if (new_ptr == NULL)
+    {
+      return NULL;
+    }
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+// an aligned object is freed like any other, into the magazines of its class.
+// The object the magazines hand out is taken if it is aligned, which it is when
+// the backend aligns all objects of the class or aligned objects are freed and
+// allocated again. Otherwise it comes from the backend, as large as its class
+void*
+kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if (alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    {
+      return NULL;
+    }
+
+  if (size <= 0 || size > MAG_MAX)
+    {
+      pthread_mutex_lock(&gBackendLock);
+      void* ptr = kma_backend_memalign(alignment, size);
+      pthread_mutex_unlock(&gBackendLock);
+
+      if (ptr != NULL)
+        {
+          __sync_add_and_fetch(&gLiveObjects, 1);
+        }
+
+      return ptr;
+    }
+
+  int class = (size - 1) / MAG_GRANULE;
+  void* ptr = kma_malloc(size);
+
+  if (ptr == NULL || (unsigned long)ptr % alignment == 0)
+    {
+      return ptr;
+    }
+
+  // back on top of its magazine for the next kma_malloc
+  kma_free(ptr, size);
+
+  pthread_mutex_lock(&gBackendLock);
+  ptr = kma_backend_memalign(alignment, (class + 1) * MAG_GRANULE);
+  pthread_mutex_unlock(&gBackendLock);
+
+  if (ptr != NULL)
+    {
+      __sync_add_and_fetch(&gLiveObjects, 1);
+    }
+
+  return ptr;
+}
+
+// objects in magazines were used before, only the ones that don't go through
+// them can come from a page the backend knows is zero
+void*
+kma_calloc(kma_size_t count, kma_size_t size)
+{
+  // nothing is zeroed for a count or size below 1, and no request fits in
+  // more than a page, which together keep count * size from overflowing
+  if (count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    {
+      return NULL;
+    }
+
+  size *= count;
+
+  if (size > MAG_MAX)
+    {
+      pthread_mutex_lock(&gBackendLock);
+      void* ptr = kma_backend_calloc(1, size);
+      pthread_mutex_unlock(&gBackendLock);
+
+      if (ptr != NULL)
+        {
+          __sync_add_and_fetch(&gLiveObjects, 1);
+        }
+
+      return ptr;
+    }
+
+  void* ptr = kma_malloc(size);
+
+  if (ptr != NULL)
+    {
+      memset(ptr, 0, size);
+    }
+
+  return ptr;
+}
+
+#endif // KMA_MAGAZINE
@@ -0,0 +1,478 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Meta-allocator that routes each size band to the allocator
+ *             that did best on it
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ ***************************************************************************/
+#ifdef KMA_META
+#define __KMA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+// a band is the power of 2 range a size falls in, with the power of 2 itself
+// as a band of its own: 1, 2, 3-4, 4, 5-7, 8, ... 4097-8191, 8192
+#define META_ORDERS 14
+#define META_BANDS (2 * META_ORDERS)
+
+#define MAX_BACKENDS 4
+
+// while a band explores, one request in EXPLORE_EVERY goes to the backends in
+// turn and is measured, the others stay on the band's backend. It decides once
+// every backend has taken at least EXPLORE_REQUESTS requests and EXPLORE_BYTES
+// bytes of it, or EXPLORE_MAX requests for bands of small sizes
+#define EXPLORE_EVERY 4
+#define EXPLORE_REQUESTS 64
+#define EXPLORE_BYTES (16 * PAGESIZE)
+#define EXPLORE_MAX 1024
+
+// a band explores again after this many requests on its chosen backend
+#define REEXPLORE_REQUESTS 16384
+
+// backends whose footprint is within this of the smallest, give or take a page
+// either way, count as equal and the fastest of them wins
+#define FOOTPRINT_SLACK 0.10
+
+typedef struct
+{
+  char*       name;
+  void*       (*malloc)(kma_size_t);
+  void        (*free)(void*, kma_size_t);
+  void        (*free_unsized)(void*);
+  kma_size_t  (*usable_size)(void*);
+  void*       (*realloc)(void*, kma_size_t, kma_size_t);
+  void*       (*memalign)(kma_size_t, kma_size_t);
+  void*       (*calloc)(kma_size_t, kma_size_t);
+} meta_backend_t;
+
+// what a band has seen of a backend while exploring
+typedef struct
+{
+  int     requests;
+  long    bytes;        // bytes requested
+  int     pages;        // pages taken while serving them
+  int     ops;          // mallocs timed
+  double  seconds;
+  double  slowest;      // left out of the average, it is mostly setting up pages
+} meta_sample_t;
+
+typedef struct
+{
+  int            backend;    // where mallocs go that aren't measured
+  bool           exploring;
+  int            next;       // backend the next measured request goes to
+  int            requests;   // requests since the last decision
+  meta_sample_t  samples[MAX_BACKENDS];
+} meta_band_t;
+
+/************Global Variables*********************************************/
+
+void* kma_rm_malloc(kma_size_t);
+void kma_rm_free(void*, kma_size_t);
+void kma_rm_free_unsized(void*);
+kma_size_t kma_rm_usable_size(void*);
+void* kma_rm_realloc(void*, kma_size_t, kma_size_t);
+void* kma_rm_memalign(kma_size_t, kma_size_t);
+void* kma_rm_calloc(kma_size_t, kma_size_t);
+void* kma_bud_malloc(kma_size_t);
+void kma_bud_free(void*, kma_size_t);
+void kma_bud_free_unsized(void*);
+kma_size_t kma_bud_usable_size(void*);
+void* kma_bud_realloc(void*, kma_size_t, kma_size_t);
+void* kma_bud_memalign(kma_size_t, kma_size_t);
+void* kma_bud_calloc(kma_size_t, kma_size_t);
+void* kma_slab_malloc(kma_size_t);
+void kma_slab_free(void*, kma_size_t);
+void kma_slab_free_unsized(void*);
+kma_size_t kma_slab_usable_size(void*);
+void* kma_slab_realloc(void*, kma_size_t, kma_size_t);
+void* kma_slab_memalign(kma_size_t, kma_size_t);
+void* kma_slab_calloc(kma_size_t, kma_size_t);
+
+// the allocators linked in (-DKMA_RM, -DKMA_BUD, -DKMA_SLAB). Bands start out
+// on the first one
+static meta_backend_t kBackends[] = {
+#ifdef KMA_RM
+  { "rm",   kma_rm_malloc,   kma_rm_free,   kma_rm_free_unsized,   kma_rm_usable_size,   kma_rm_realloc,   kma_rm_memalign,   kma_rm_calloc   },
+#endif
+#ifdef KMA_BUD
+  { "bud",  kma_bud_malloc,  kma_bud_free,  kma_bud_free_unsized,  kma_bud_usable_size,  kma_bud_realloc,  kma_bud_memalign,  kma_bud_calloc  },
+#endif
+#ifdef KMA_SLAB
+  { "slab", kma_slab_malloc, kma_slab_free, kma_slab_free_unsized, kma_slab_usable_size, kma_slab_realloc, kma_slab_memalign, kma_slab_calloc },
+#endif
+};
+
+#define NUM_BACKENDS ((int)(sizeof(kBackends) / sizeof(kBackends[0])))
+
+static meta_band_t gBands[META_BANDS];
+static bool gBandsReady = FALSE;
+
+// backend that owns each page, by page number. The page pool is MAXPAGES
+// contiguous pages, so no two pages in use share an entry. A page's entry is
+// set by every malloc that returns memory in it, which always happens before
+// anything in it is freed
+static unsigned char gOwner[MAXPAGES];
+
+// number of requests seen, to place the decisions in the log
+static long gRequests = 0;
+
+static FILE* gLog = NULL;
+
+/************Function Prototypes******************************************/
+void init_bands();
+int band_of(kma_size_t size);
+double now();
+void sample(meta_sample_t* s, double seconds, int pages);
+double average_time(meta_sample_t* s);
+void decide(int band);
+void band_range(int band, int* low, int* high);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+// starts every band exploring. The log goes to stderr or to the file named by
+// KMA_META_LOG
+void
+init_bands()
+{
+  int band;
+  char* path = getenv("KMA_META_LOG");
+
+  assert(NUM_BACKENDS > 0 && NUM_BACKENDS <= MAX_BACKENDS);
+
+  gLog = stderr;
+  if (path != NULL)
+    {
+      gLog = fopen(path, "a");
+      if (gLog == NULL)
+        {
+          error("can't open KMA_META_LOG", path);
+        }
+    }
+
+  for (band = 0; band < META_BANDS; band++)
+    {
+      gBands[band].backend = 0;
+      gBands[band].exploring = NUM_BACKENDS > 1;
+      gBands[band].next = 0;
+      gBands[band].requests = 0;
+    }
+
+  gBandsReady = TRUE;
+}
+
+int
+band_of(kma_size_t size)
+{
+  int order = size <= 1 ? 0 : 32 - __builtin_clz(size - 1);
+
+  return 2 * order + ((size & (size - 1)) == 0);
+}
+
+// the sizes of a band, for the log
+void
+band_range(int band, int* low, int* high)
+{
+  int order = band / 2;
+
+  if (band % 2 == 1)
+    {
+      *low = *high = 1 << order;
+    }
+  else
+    {
+      *low = order == 0 ? 1 : (1 << (order - 1)) + 1;
+      *high = (1 << order) - 1;
+    }
+}
+
+double
+now()
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// adds one timed malloc
+void
+sample(meta_sample_t* s, double seconds, int pages)
+{
+  s->seconds += seconds;
+  s->ops++;
+  s->pages += pages;
+
+  if (seconds > s->slowest)
+    {
+      s->slowest = seconds;
+    }
+}
+
+double
+average_time(meta_sample_t* s)
+{
+  return s->ops > 1 ? (s->seconds - s->slowest) / (s->ops - 1) : s->seconds;
+}
+
+// every backend has been tried enough on the band: take the fastest of those
+// with the smallest footprint (page bytes taken per byte requested), and log it.
+// Pages come one at a time, so a footprint is only known to a page either way
+void
+decide(int band)
+{
+  meta_band_t* b = &gBands[band];
+  double footprint[MAX_BACKENDS];
+  double error[MAX_BACKENDS];
+  int i, smallest = 0, best = -1, low, high;
+
+  for (i = 0; i < NUM_BACKENDS; i++)
+    {
+      footprint[i] = (double)b->samples[i].pages * PAGESIZE / b->samples[i].bytes;
+      error[i] = (double)PAGESIZE / b->samples[i].bytes;
+      if (footprint[i] < footprint[smallest])
+        {
+          smallest = i;
+        }
+    }
+
+  for (i = 0; i < NUM_BACKENDS; i++)
+    {
+      if (footprint[i] - error[i] <= footprint[smallest] + error[smallest] + FOOTPRINT_SLACK
+          && (best < 0 || average_time(&b->samples[i]) < average_time(&b->samples[best])))
+        {
+          best = i;
+        }
+    }
+
+  b->backend = best;
+  b->exploring = FALSE;
+  b->requests = 0;
+
+  band_range(band, &low, &high);
+  fprintf(gLog, "kma_meta: request %ld: sizes %d-%d:", gRequests, low, high);
+  for (i = 0; i < NUM_BACKENDS; i++)
+    {
+      fprintf(gLog, " %s %.2f bytes/byte %.0f ns%s", kBackends[i].name, footprint[i],
+              average_time(&b->samples[i]) * 1e9, i < NUM_BACKENDS - 1 ? "," : "");
+    }
+  fprintf(gLog, " -> %s\n", kBackends[best].name);
+  fflush(gLog);
+}
+
+void*
+kma_malloc(kma_size_t size)
+{
+  if (size <= 0 || size > PAGESIZE)
+    {
+      return NULL;
+    }
+
+  if (!gBandsReady)
+    {
+      init_bands();
+    }
+
+  int band = band_of(size);
+  meta_band_t* b = &gBands[band];
+  void* ptr;
+  int backend;
+
+  gRequests++;
+  b->requests++;
+
+  if (!b->exploring || b->requests % EXPLORE_EVERY != 0)
+    {
+      backend = b->backend;
+      ptr = kBackends[backend].malloc(size);
+
+      if (!b->exploring && b->requests >= REEXPLORE_REQUESTS && NUM_BACKENDS > 1)
+        {
+          int i;
+
+          for (i = 0; i < NUM_BACKENDS; i++)
+            {
+              meta_sample_t empty = { 0, 0, 0, 0, 0, 0 };
+              b->samples[i] = empty;
+            }
+          b->exploring = TRUE;
+          b->requests = 0;
+        }
+    }
+  else
+    {
+      // measure the backends round robin, so each sees the same part of the trace
+      backend = b->next;
+      b->next = (b->next + 1) % NUM_BACKENDS;
+
+      meta_sample_t* s = &b->samples[backend];
+      int pages = page_stats()->num_in_use;
+      double start = now();
+
+      ptr = kBackends[backend].malloc(size);
+
+      sample(s, now() - start, page_stats()->num_in_use - pages);
+      s->requests++;
+      s->bytes += size;
+
+      int i, done = 0;
+      for (i = 0; i < NUM_BACKENDS; i++)
+        {
+          meta_sample_t* t = &b->samples[i];
+
+          done += (t->requests >= EXPLORE_REQUESTS && t->bytes >= EXPLORE_BYTES)
+                  || t->requests >= EXPLORE_MAX;
+        }
+      if (done == NUM_BACKENDS)
+        {
+          decide(band);
+        }
+    }
+
+  if (ptr != NULL)
+    {
+      gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES] = backend;
+    }
+
+  return ptr;
+}
+
+void
+kma_free(void* ptr, kma_size_t size)
+{
+  // frees aren't measured: most objects of an exploring band came from its
+  // backend without being measured, the free can't be told apart
+  kBackends[gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES]].free(ptr, size);
+}
+
+// the page says which backend owns the object, and the backend finds the rest
+// from its own metadata of the page
+void
+kma_free_unsized(void* ptr)
+{
+  kBackends[gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES]].free_unsized(ptr);
+}
+
+kma_size_t
+kma_usable_size(void* ptr)
+{
+  return kBackends[gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES]].usable_size(ptr);
+}
+
+// the backend that owns the memory resizes it (in place if it can) when the new
+// size's band goes to it as well, otherwise it moves to the band's backend
+void*
+kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  int backend = gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES];
+  void* new_ptr;
+
+  if (new_size <= 0 || new_size > PAGESIZE)
+    {
+      return NULL;
+    }
+
+  if (gBands[band_of(new_size)].backend == backend)
+    {
+      new_ptr = kBackends[backend].realloc(ptr, old_size, new_size);
+      if (new_ptr != NULL)
+        {
+          gOwner[(long)BASEADDR(new_ptr) / PAGESIZE % MAXPAGES] = backend;
+        }
+
+      return new_ptr;
+    }
+
+  new_ptr = kma_malloc(new_size);
+  if (new_ptr == NULL)
+    {
+      return NULL;
+    }
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+// aligned requests go to the backend of their size's band and are not measured
+void*
+kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if (size <= 0 || size > PAGESIZE || alignment <= 0
+      || (alignment & (alignment - 1)) != 0)
+    {
+      return NULL;
+    }
+
+  if (!gBandsReady)
+    {
+      init_bands();
+    }
+
+  int backend = gBands[band_of(size)].backend;
+  void* ptr = kBackends[backend].memalign(alignment, size);
+
+  if (ptr != NULL)
+    {
+      gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES] = backend;
+    }
+
+  return ptr;
+}
+
+// zeroed requests go to the backend of their size's band and are not measured
+void*
+kma_calloc(kma_size_t count, kma_size_t size)
+{
+  // nothing is zeroed for a count or size below 1, and no request fits in
+  // more than a page, which together keep count * size from overflowing
+  if (count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    {
+      return NULL;
+    }
+
+  if (!gBandsReady)
+    {
+      init_bands();
+    }
+
+  int backend = gBands[band_of(count * size)].backend;
+  void* ptr = kBackends[backend].calloc(count, size);
+
+  if (ptr != NULL)
+    {
+      gOwner[(long)BASEADDR(ptr) / PAGESIZE % MAXPAGES] = backend;
+    }
+
+  return ptr;
+}
+
+#endif // KMA_META
@@ -45,6 +45,7 @@
 #include <string.h>
 #include <strings.h>
 #include <stdio.h>
+#include <sys/mman.h>
 
 /************Private include**********************************************/
 #include "kma_page.h"
@@ -57,14 +58,35 @@
  *  structures and arrays, line everything up in neat columns.
  */
 
+// number of released pages kept with their contents (a quarter of the pool).
+// The ones beyond are given back to the system with MADV_DONTNEED, which makes
+// a private anonymous page read back as zeros on Linux, at the cost of a page
+// fault when it is used again. Elsewhere it is only a hint, so all are kept
+#ifdef __linux__
+#define DIRTY_MAX 1024
+#else
+#define DIRTY_MAX MAXPAGES
+#endif
+
 /************Global Variables*********************************************/
 static kma_page_stat_t kma_page_stats = { 0, 0, 0, PAGESIZE };
 
 static void* pool = NULL;
+static void* pool_map = NULL; // the mapping the pool was aligned in
+
+// released pages that kept their contents, linked through their first word
 static void* next_free_page = NULL;
+static int num_dirty = 0;
+
+// released pages given back to the system, they are zero again
+static void* zero_pages[MAXPAGES];
+static int num_zero = 0;
+
+// pages of the pool handed out so far, the ones after them were never touched
+static int num_fresh = 0;
 
 /************Function Prototypes******************************************/
-void* allocPage();
+void* allocPage(int*);
 void freePage(void*);
 void initPages();
 
@@ -78,13 +100,15 @@ get_page()
   static int id = 0;
   kma_page_t* res;
   
-  kma_page_stats.num_requested++;
-  kma_page_stats.num_in_use++;
+  // the counters are read by page_stats() without the lock of the allocator
+  // that calls get_page/free_page, so they are updated atomically
+  __atomic_add_fetch(&kma_page_stats.num_requested, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&kma_page_stats.num_in_use, 1, __ATOMIC_RELAXED);
   
   res = (kma_page_t*) malloc(sizeof(kma_page_t));
   res->id = id++;
   res->size = kma_page_stats.page_size;
-  res->ptr = allocPage();
+  res->ptr = allocPage(&res->zero);
   
   assert(res->ptr != NULL);
 
@@ -98,8 +122,8 @@ free_page(kma_page_t* ptr)
   assert(ptr->ptr != NULL);
   assert(kma_page_stats.num_in_use > 0);
   
-  kma_page_stats.num_freed++;
-  kma_page_stats.num_in_use--;
+  __atomic_add_fetch(&kma_page_stats.num_freed, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&kma_page_stats.num_in_use, 1, __ATOMIC_RELAXED);
   
   freePage(ptr->ptr);
   free(ptr);
@@ -108,13 +132,21 @@ free_page(kma_page_t* ptr)
 kma_page_stat_t*
 page_stats()
 {
-  static kma_page_stat_t stats;
+  // one copy per thread, so threads taking stats don't overwrite each other's
+  static __thread kma_page_stat_t stats;
+  
+  stats.num_requested = __atomic_load_n(&kma_page_stats.num_requested, __ATOMIC_RELAXED);
+  stats.num_freed = __atomic_load_n(&kma_page_stats.num_freed, __ATOMIC_RELAXED);
+  stats.num_in_use = __atomic_load_n(&kma_page_stats.num_in_use, __ATOMIC_RELAXED);
+  stats.page_size = kma_page_stats.page_size;
   
-  return memcpy(&stats, &kma_page_stats, sizeof(kma_page_stat_t));
+  return &stats;
 }
 
+// reuses a released page that kept its contents first, it is most likely
+// still in the cache, then one that was given back, then a fresh one
 void*
-allocPage()
+allocPage(int* zero)
 {
   void* res;
   
@@ -123,14 +155,27 @@ allocPage()
       initPages();
     }
   
-  res = next_free_page;
-  
-  if (res == NULL)
+  if (next_free_page != NULL)
     {
-      error("error: all pages already allocated", "");
+      res = next_free_page;
+      next_free_page = *((void**)next_free_page);
+      num_dirty--;
+      *zero = 0;
+    }
+  else if (num_zero > 0)
+    {
+      res = zero_pages[--num_zero];
+      *zero = 1;
+    }
+  else
+    {
+      if (num_fresh == MAXPAGES)
+        {
+          error("error: all pages already allocated", "");
+        }
+      res = pool + num_fresh++ * PAGESIZE;
+      *zero = 1;
     }
-  
-  next_free_page = *((void**)next_free_page);
   
   assert(res != NULL);
   
@@ -142,39 +187,46 @@ freePage(void* ptr)
 {
   assert(ptr != NULL);
   
-  *((void**)ptr) = next_free_page;
-  next_free_page = ptr;
-  
   if (kma_page_stats.num_in_use == 0)
     {
-      free(pool);
+      munmap(pool_map, (MAXPAGES + 1) * PAGESIZE);
       pool = NULL;
+      pool_map = NULL;
       next_free_page = NULL;
+      num_dirty = 0;
+      num_zero = 0;
+      num_fresh = 0;
+      return;
+    }
+  
+  if (num_dirty < DIRTY_MAX || madvise(ptr, PAGESIZE, MADV_DONTNEED) != 0)
+    {
+      *((void**)ptr) = next_free_page;
+      next_free_page = ptr;
+      num_dirty++;
+    }
+  else
+    {
+      zero_pages[num_zero++] = ptr;
     }
 }
 
+// maps the pool, which the system hands out zeroed. Pages are laid out one
+// after the other as they are first needed, so the ones never used are never
+// touched
 void
 initPages()
 {
-  int i;
-  
   assert(next_free_page == NULL);
   assert(pool == NULL);
   
-  //pool = calloc(MAXPAGES, PAGESIZE);
-  int result = posix_memalign(&pool, PAGESIZE, MAXPAGES * PAGESIZE);
-  if(result)
-    error("Error using posix_memalign to allocate memory", "");
-  next_free_page = pool;
-  
-  // use ptr to point to the next free page struct
-  for (i = 0; i < (MAXPAGES - 1); i++)
+  // one page more than needed to align the pool to a page
+  pool_map = mmap(NULL, (MAXPAGES + 1) * PAGESIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pool_map == MAP_FAILED)
     {
-      void* ptr = (pool + i * PAGESIZE);
-      void* next = ptr + PAGESIZE;
-      
-      *((void**) ptr) = next;
+      pool_map = NULL;
+      error("Error using mmap to allocate memory", "");
     }
-  
-  *((void**)(pool + (MAXPAGES - 1) * PAGESIZE)) = NULL;
+  pool = (void*)(((long)pool_map + PAGESIZE - 1) & ~(PAGESIZE - 1));
 }
@@ -81,6 +81,7 @@ typedef struct
   int id;
   void* ptr;
   int size;
+  int zero; // 1 if the page holds only zeros when get_page() returns it
 } kma_page_t;
 
 typedef struct
@@ -98,7 +99,10 @@ typedef struct
 /***********************************************************************
  *  Title: Allocates a memory page
  * ---------------------------------------------------------------------
- *    Purpose: Allocates a memory page
+ *    Purpose: Allocates a memory page. Pages that were never handed
+ *             out, or were given back to the system since, come
+ *             zeroed and have their zero flag set, so an allocator
+ *             can skip clearing them
  *    Input: none
  *    Output: the allocated memory page
  ***********************************************************************/
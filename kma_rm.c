@@ -33,11 +33,14 @@
  ***************************************************************************/
 #ifdef KMA_RM
 #define __KMA_IMPL__
+//name of this allocator's kma_ entry points when it is linked into the meta-allocator (KMA_META)
+#define KMA_BACKEND rm
 
 /************System include***********************************************/
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 /************Private include**********************************************/
 #include "kma_page.h"
@@ -53,36 +56,174 @@
  #define TAKEN TRUE
  #define FREE FALSE
 
- #define LAST TRUE
- #define NOT_LAST FALSE
-
  #define PAGE_SIZE 8192
 
+ //smallest payload a frame can have (a free frame keeps its free list links and its footer in the payload)
+ #define MIN_PAYLOAD 24
+
+ //smallest frame worth splitting off a larger one
+ #define MIN_FRAME ((int)sizeof(kma_frame) + MIN_PAYLOAD)
+
+ //largest payload of a frame, a whole page less the page header and one tag
+ #define FRAME_MAX (PAGE_SIZE - (int)sizeof(kma_map_page) - (int)sizeof(kma_frame))
+
+ //a larger request gets a page of its own outside the maps. It starts with its page object
+ //like a map page does, with the lowest bit set to tell the two apart (page objects come
+ //from malloc, so the bit is otherwise 0)
+ #define BIG_PAGE_BIT 1L
+ #define IS_BIG_PAGE(ptr) (*(long*)BASEADDR(ptr) & BIG_PAGE_BIT)
+ #define BIG_PAGE_OF(ptr) ((kma_page_t*)(*(long*)BASEADDR(ptr) & ~BIG_PAGE_BIT))
+
+ //number of segregated free lists, list i holds free frames with payload in [16 << i, 32 << i)
+ #define FREE_CLASSES 9
+
+ //placement policies, picked at build time with -DRM_POLICY=... or at run time
+ //with the KMA_RM_POLICY environment variable (segregated, first, next, best, worst, page)
+ #define RM_SEGREGATED_FIT 0
+ #define RM_FIRST_FIT 1
+ #define RM_NEXT_FIT 2
+ #define RM_BEST_FIT 3
+ #define RM_WORST_FIT 4
+ #define RM_PAGE_FIT 5
+
+ //largest payload parked in the fast bins when freed (-DFAST_MAX=0 turns them off)
+ #ifndef FAST_MAX
+ #define FAST_MAX 128
+ #endif
+
+ //number of fast bins, bin i holds frames with a payload of exactly MIN_PAYLOAD + 8*i bytes
+ #define FAST_BINS ((FAST_MAX < MIN_PAYLOAD) ? 1 : (FAST_MAX - MIN_PAYLOAD) / 8 + 1)
+
+ //number of parked frames that triggers a consolidation
+ #define FAST_LIMIT 256
+
+ //largest_free of a page whose largest free frame was taken out and has to be looked up again
+ #define UNKNOWN_LARGEST -1
+
+ #ifndef RM_POLICY
+ #define RM_POLICY RM_SEGREGATED_FIT
+ #endif
+
+ //number of size bands, each with a resource map of its own (-DRM_BANDS=1 puts every size in one map)
+ #ifndef RM_BANDS
+ #define RM_BANDS 3
+ #endif
+
 typedef struct kma_frame kma_frame;
 
+//boundary tag at the start of every frame. A free frame repeats it as a footer in its
+//last 8 bytes, so the frame after it can find it from the size alone
 struct kma_frame
 {
-  kma_page_t* page;
-  kma_frame* prev;//the pointer to the previous frame
-  kma_frame* next;//the pointer to the next frame
+  int size;//size of the whole frame, this tag included
   bool occupied;
-  bool last;//true when last in "chain"
+  bool prev_occupied;//true when the frame just before is taken (or this is the first frame of its page)
+};
+
+typedef struct kma_map_page kma_map_page;
+
+typedef struct kma_map kma_map;
+
+//lives at the start of every page of the map, the frames follow it
+struct kma_map_page
+{
+  kma_page_t* page;//the page object to hand back to free_page
+  kma_map* map;//the map this page belongs to
+  kma_map_page* prev_page;
+  kma_map_page* next_page;
+  int free_bytes;//bytes in the free frames of this page, tags included
+  int largest_free;//payload of the largest free frame of this page
+  kma_map_page* prev_indexed;//the previous page in the same page list
+  kma_map_page* next_indexed;//the next page in the same page list
+  int indexed_class;//page list this page is on (-1 when it has no free frame)
+  bool zero;//the page came zeroed and none of its frames was freed yet, so its only free frame is the
+            //one at its end, which holds nothing but its tag, its free list links and its footer
+};
+
+//one resource map, every size band has its own pages and free frame indexes
+struct kma_map
+{
+  kma_map_page* head;//first and last pages (new pages get attached after the last one)
+  kma_map_page* tail;
+  kma_frame* free_lists[FREE_CLASSES];//heads of the segregated free lists
+  kma_map_page* page_lists[FREE_CLASSES];//heads of the page lists, list i holds the pages whose largest free frame is in free list i
+  kma_frame* free_tree;//root of the size ordered tree of free frames
+  kma_frame* rover;//where the next next fit search starts
+};
+
+typedef struct kma_free_links kma_free_links;
+
+//lives in the payload of every free frame (segregated fit)
+struct kma_free_links
+{
+  kma_frame* prev_free;//the previous frame in the same free list
+  kma_frame* next_free;//the next frame in the same free list
+};
+
+typedef struct kma_tree_links kma_tree_links;
+
+//lives in the payload of every free frame (best and worst fit). Free frames form a
+//treap ordered by (size, address) whose priorities are a hash of the frame address
+struct kma_tree_links
+{
+  kma_frame* left;//frames with a smaller (size, address)
+  kma_frame* right;//frames with a larger (size, address)
 };
 
 /************Global Variables*********************************************/
 
 
-kma_page_t* entry_page = NULL;
+//one map per size band
+kma_map maps[RM_BANDS];
+
+//largest payload of each band but the last (which takes everything else)
+static const int kBandLimit[] = { 128, 1024 };
+
+//true once the maps are set up
+bool maps_ready = FALSE;
+
+//heads of the fast bins, parked frames are linked through the first word of their payload
+kma_frame* fast_bins[FAST_BINS];
+
+//number of frames parked in the fast bins
+int fast_count = 0;
+
+//number of frames handed out by kma_malloc and not freed yet
+static int live_count = 0;
+
+//placement policy in use, only changed while the maps are empty
+int rm_policy = RM_POLICY;
 
 
 /************Function Prototypes******************************************/
- //each memory "frame" looks like this
-//byte 0: pointer to kma_page_t that allocated this memory
-//byte 4: int (0 means free, 1 means taken)
-//byte 8: int, size
+ //each page looks like this
+//byte 0: kma_map_page (page object, owning map, neighbouring pages, free summary)
+//then the frames, each one an 8 byte tag (size, taken, previous taken) followed by
+//its payload. Free frames keep their free list links at the start of the payload
+//and a copy of the tag at the end
 
-kma_frame* write_new_frame(void* addr, kma_page_t* page, kma_frame* prev, kma_frame* next, bool occupied, bool last);
+void write_frame(kma_frame* frame, int size, bool occupied, bool prev_occupied);
 void* data_ptr(kma_frame* current);
+int free_class(int size);
+void insert_free(kma_frame* frame);
+void remove_free(kma_frame* frame);
+kma_frame* find_free(kma_map* map, int size);
+void list_insert(kma_map* map, kma_frame* frame);
+void list_remove(kma_map* map, kma_frame* frame);
+kma_frame* list_find(kma_map* map, int size);
+kma_frame* tree_insert(kma_frame* root, kma_frame* frame);
+kma_frame* tree_remove(kma_frame* root, kma_frame* frame);
+kma_frame* tree_find_best(kma_map* map, int size);
+kma_frame* tree_find_worst(kma_map* map, int size);
+kma_frame* chain_find(kma_map* map, kma_frame* start, int size);
+kma_frame* page_find(kma_map* map, int size);
+int page_largest_free(kma_map_page* page);
+void index_page(kma_map_page* page);
+void consolidate();
+void forget_frame(kma_frame* gone, kma_frame* replacement);
+void shrink_frame(kma_frame* frame, int size);
+kma_frame* aligned_frame(kma_frame* frame, int align);
+void* big_memalign(kma_size_t alignment, kma_size_t size);
 void print_debug();
 
 /************External Declaration*****************************************/
@@ -91,46 +232,72 @@ void print_debug();
  
 
 
-kma_frame* write_new_frame(void* addr, kma_page_t* page, kma_frame* prev, kma_frame* next, bool occupied, bool last){
+void write_frame(kma_frame* frame, int size, bool occupied, bool prev_occupied){
 
-  kma_frame* frame = (kma_frame*) addr;
+	frame->size = size;
 
-  // add a pointer to the page structure at the beginning of the page
-  frame->page = page;
+	frame->occupied = occupied;
 
-  frame->prev = prev;
+	frame->prev_occupied = prev_occupied;
 
-  frame->next = next;
+	//free frames end with a copy of their tag
+	if(occupied == FREE)
+		*((kma_frame*)((char*)frame + size) - 1) = *frame;
 
-  //set equal to free
-  frame->occupied = occupied;
+}
 
-  frame->last = last;
+//payload size of a frame
+int frame_size(kma_frame* frame){
 
-  return frame;
+	return frame->size - sizeof(kma_frame);
 
 }
 
-int frame_size(kma_frame* frame){
+kma_map_page* map_page(kma_frame* frame){
 
-	return ((char*)frame->next) - (  ((char*)frame)   + sizeof(kma_frame)  );
+	return (kma_map_page*)BASEADDR(frame);
+}
+
+kma_frame* page_first_frame(kma_map_page* page){
 
+	return (kma_frame*)(page + 1);//add sizeof(kma_map_page)
 }
 
+kma_frame* first_frame(kma_map* map){
 
-kma_frame* last_frame(){
+	return page_first_frame(map->head);
+}
 
-	kma_frame* current = (kma_frame*)entry_page->ptr;
+//the map that serves payloads of this size
+kma_map* band_map(int size){
 
-	while(current->last == NOT_LAST){
-		current = current->next;
+	int band = 0;
+
+	while(band < RM_BANDS - 1 && size > kBandLimit[band]){
+		band++;
 	}
-	return current;
+
+	return &maps[band];
 }
 
-kma_frame* first_frame(){
+//true when the frame runs to the end of its page
+bool last_frame_in_page(kma_frame* frame){
 
-	return (kma_frame*)entry_page->ptr;
+	return (char*)frame + frame->size == (char*)BASEADDR(frame) + PAGE_SIZE;
+}
+
+//the frame right after this one, only valid if it isn't the last one in its page
+kma_frame* next_frame(kma_frame* frame){
+
+	return (kma_frame*)((char*)frame + frame->size);
+}
+
+//the frame right before this one, only valid if that frame is free (it has a footer)
+kma_frame* prev_frame(kma_frame* frame){
+
+	kma_frame* prev_footer = frame - 1;
+
+	return (kma_frame*)((char*)frame - prev_footer->size);
 }
 
 void* data_ptr(kma_frame* current){
@@ -138,34 +305,476 @@ void* data_ptr(kma_frame* current){
 	return current + 1;//add sizeof(kma_frame)
 }
 
+kma_free_links* free_links(kma_frame* frame){
+
+	return (kma_free_links*)data_ptr(frame);
+}
+
+//index of the free list that holds frames with this payload size
+int free_class(int size){
+
+	int class = (31 - __builtin_clz(size)) - 4;
+
+	return class < FREE_CLASSES ? class : FREE_CLASSES - 1;
+}
+
+//adds a frame that just became free to the index of the placement policy
+void insert_free(kma_frame* frame){
+
+	kma_map_page* page = map_page(frame);
+	kma_map* map = page->map;
+
+	page->free_bytes += frame->size;
+	if(page->largest_free != UNKNOWN_LARGEST && frame_size(frame) > page->largest_free)
+		page->largest_free = frame_size(frame);
+
+	if(rm_policy == RM_SEGREGATED_FIT)
+		list_insert(map, frame);
+	else if(rm_policy == RM_BEST_FIT || rm_policy == RM_WORST_FIT)
+		map->free_tree = tree_insert(map->free_tree, frame);
+	//first and next fit walk the chain and keep no index
+}
+
+//takes a free frame out of the index of the placement policy, must be called before its size changes
+void remove_free(kma_frame* frame){
+
+	kma_map_page* page = map_page(frame);
+	kma_map* map = page->map;
+
+	page->free_bytes -= frame->size;
+	if(frame_size(frame) == page->largest_free)
+		page->largest_free = UNKNOWN_LARGEST;//looked up again by page_largest_free
+
+	if(rm_policy == RM_SEGREGATED_FIT)
+		list_remove(map, frame);
+	else if(rm_policy == RM_BEST_FIT || rm_policy == RM_WORST_FIT)
+		map->free_tree = tree_remove(map->free_tree, frame);
+}
+
+//returns a free frame of the map with at least size bytes of payload picked by the placement policy,
+//or NULL if there is none
+kma_frame* find_free(kma_map* map, int size){
+
+	if(map->head == NULL)
+		return NULL;
+
+	switch(rm_policy){
+		case RM_FIRST_FIT:
+			return chain_find(map, first_frame(map), size);
+		case RM_NEXT_FIT:
+			return chain_find(map, map->rover != NULL ? map->rover : first_frame(map), size);
+		case RM_BEST_FIT:
+			return tree_find_best(map, size);
+		case RM_WORST_FIT:
+			return tree_find_worst(map, size);
+		case RM_PAGE_FIT:
+			return page_find(map, size);
+		default:
+			return list_find(map, size);
+	}
+}
+
+//pushes a free frame on the front of the free list for its size
+void list_insert(kma_map* map, kma_frame* frame){
+
+	int class = free_class(frame_size(frame));
+
+	free_links(frame)->prev_free = NULL;
+	free_links(frame)->next_free = map->free_lists[class];
+
+	if(map->free_lists[class] != NULL)
+		free_links(map->free_lists[class])->prev_free = frame;
+
+	map->free_lists[class] = frame;
+}
+
+//unlinks a free frame from its free list
+void list_remove(kma_map* map, kma_frame* frame){
+
+	kma_free_links* links = free_links(frame);
+
+	if(links->prev_free != NULL)
+		free_links(links->prev_free)->next_free = links->next_free;
+	else
+		map->free_lists[free_class(frame_size(frame))] = links->next_free;
+
+	if(links->next_free != NULL)
+		free_links(links->next_free)->prev_free = links->prev_free;
+}
+
+//returns a free frame from the segregated free lists
+kma_frame* list_find(kma_map* map, int size){
+
+	int class = free_class(size);
+
+	//frames in the request's own class may be too small, so walk that list first fit
+	kma_frame* current = map->free_lists[class];
+	while(current != NULL && frame_size(current) < size){
+		current = free_links(current)->next_free;
+	}
+
+	if(current != NULL)
+		return current;
+
+	//any frame in a larger class fits
+	for(class = class + 1; class < FREE_CLASSES; class++){
+		if(map->free_lists[class] != NULL)
+			return map->free_lists[class];
+	}
+
+	return NULL;
+}
+
+kma_tree_links* tree_links(kma_frame* frame){
+
+	return (kma_tree_links*)data_ptr(frame);
+}
+
+//treap priority of a frame, a hash of its address so it doesn't need to be stored
+unsigned int tree_priority(kma_frame* frame){
+
+	return (unsigned int)((((unsigned long)frame) * 0x9E3779B97F4A7C15UL) >> 32);
+}
+
+//true when frame a orders before frame b by (size, address)
+bool tree_less(kma_frame* a, kma_frame* b){
+
+	int size_a = frame_size(a);
+	int size_b = frame_size(b);
+
+	return size_a < size_b || (size_a == size_b && a < b);
+}
+
+//inserts frame into the treap under root and returns the new root
+kma_frame* tree_insert(kma_frame* root, kma_frame* frame){
+
+	if(root == NULL){
+		tree_links(frame)->left = NULL;
+		tree_links(frame)->right = NULL;
+		return frame;
+	}
+
+	kma_tree_links* links = tree_links(root);
+
+	if(tree_less(frame, root)){
+		links->left = tree_insert(links->left, frame);
+
+		//rotate right if the new child outranks root
+		if(tree_priority(links->left) > tree_priority(root)){
+			kma_frame* child = links->left;
+			links->left = tree_links(child)->right;
+			tree_links(child)->right = root;
+			return child;
+		}
+	}else{
+		links->right = tree_insert(links->right, frame);
+
+		//rotate left if the new child outranks root
+		if(tree_priority(links->right) > tree_priority(root)){
+			kma_frame* child = links->right;
+			links->right = tree_links(child)->left;
+			tree_links(child)->left = root;
+			return child;
+		}
+	}
+
+	return root;
+}
+
+//joins two treaps where every frame of left orders before every frame of right
+kma_frame* tree_merge(kma_frame* left, kma_frame* right){
+
+	if(left == NULL)
+		return right;
+	if(right == NULL)
+		return left;
+
+	if(tree_priority(left) > tree_priority(right)){
+		tree_links(left)->right = tree_merge(tree_links(left)->right, right);
+		return left;
+	}
+
+	tree_links(right)->left = tree_merge(left, tree_links(right)->left);
+	return right;
+}
+
+//removes frame from the treap under root and returns the new root
+kma_frame* tree_remove(kma_frame* root, kma_frame* frame){
+
+	if(root == frame)
+		return tree_merge(tree_links(root)->left, tree_links(root)->right);
+
+	if(tree_less(frame, root))
+		tree_links(root)->left = tree_remove(tree_links(root)->left, frame);
+	else
+		tree_links(root)->right = tree_remove(tree_links(root)->right, frame);
+
+	return root;
+}
+
+//returns the smallest free frame that fits, lowest address first among equal sizes
+kma_frame* tree_find_best(kma_map* map, int size){
+
+	kma_frame* best = NULL;
+	kma_frame* current = map->free_tree;
+
+	while(current != NULL){
+		if(frame_size(current) >= size){
+			best = current;
+			current = tree_links(current)->left;
+		}else{
+			current = tree_links(current)->right;
+		}
+	}
+
+	return best;
+}
+
+//returns the largest free frame if it fits
+kma_frame* tree_find_worst(kma_map* map, int size){
+
+	kma_frame* current = map->free_tree;
+
+	if(current == NULL)
+		return NULL;
+
+	while(tree_links(current)->right != NULL){
+		current = tree_links(current)->right;
+	}
+
+	return frame_size(current) >= size ? current : NULL;
+}
+
+//first free frame that fits in a page, starting at frame start of that page and stopping before frame end
+kma_frame* page_first_fit(kma_frame* start, kma_frame* end, int size){
+
+	kma_frame* current = start;
+
+	while(current != end){
+		if(current->occupied == FREE && frame_size(current) >= size)
+			return current;
+
+		if(last_frame_in_page(current))
+			break;
+
+		current = next_frame(current);
+	}
+
+	return NULL;
+}
+
+//walks the map from start (wrapping around to the first page) for the first free frame that fits.
+//Pages whose largest free frame is too small are skipped without looking at their frames
+kma_frame* chain_find(kma_map* map, kma_frame* start, int size){
+
+	kma_map_page* start_page = map_page(start);
+	kma_map_page* page = start_page;
+	kma_frame* found;
+
+	if(page_largest_free(page) >= size && (found = page_first_fit(start, NULL, size)) != NULL)
+		return found;
+
+	do{
+		page = (page->next_page != NULL) ? page->next_page : map->head;
+
+		//back on the first page, only the frames before start are left
+		kma_frame* end = (page == start_page) ? start : NULL;
+
+		if(page_largest_free(page) >= size && (found = page_first_fit(page_first_frame(page), end, size)) != NULL)
+			return found;
+
+	}while(page != start_page);
+
+	return NULL;
+}
+
+//jumps straight to a page that can fit size through the page lists, then takes the first frame
+//in that page that fits
+kma_frame* page_find(kma_map* map, int size){
+
+	int class = free_class(size);
+
+	//pages in the request's own class may be too small, so walk that list first fit
+	kma_map_page* page = map->page_lists[class];
+	while(page != NULL && page_largest_free(page) < size){
+		page = page->next_indexed;
+	}
+
+	//any page in a larger class fits
+	for(class = class + 1; page == NULL && class < FREE_CLASSES; class++){
+		page = map->page_lists[class];
+	}
+
+	if(page == NULL)
+		return NULL;
+
+	return page_first_fit(page_first_frame(page), NULL, size);
+}
+
+//takes a page off its page list
+void unindex_page(kma_map_page* page){
+
+	kma_map* map = page->map;
+
+	if(page->indexed_class < 0)
+		return;
+
+	if(page->prev_indexed != NULL)
+		page->prev_indexed->next_indexed = page->next_indexed;
+	else
+		map->page_lists[page->indexed_class] = page->next_indexed;
+
+	if(page->next_indexed != NULL)
+		page->next_indexed->prev_indexed = page->prev_indexed;
+
+	page->indexed_class = -1;
+}
+
+//returns the payload of the largest free frame of a page, walking the page for it only if the
+//frame that held it was taken out since it was last looked up
+int page_largest_free(kma_map_page* page){
+
+	if(page->largest_free == UNKNOWN_LARGEST){
+		page->largest_free = 0;
+
+		kma_frame* current = page_first_frame(page);
+		while(TRUE){
+			if(current->occupied == FREE && frame_size(current) > page->largest_free)
+				page->largest_free = frame_size(current);
+
+			if(last_frame_in_page(current))
+				break;
+
+			current = next_frame(current);
+		}
+	}
+
+	return page->largest_free;
+}
+
+//moves a page to the page list of its largest free frame, called once a malloc or free is done
+//with the page. Only the page policy searches the page lists, the others leave them empty
+void index_page(kma_map_page* page){
+
+	if(rm_policy != RM_PAGE_FIT)
+		return;
+
+	kma_map* map = page->map;
+	int largest = page_largest_free(page);
+	int class = (largest > 0) ? free_class(largest) : -1;
+
+	if(class == page->indexed_class)
+		return;
+
+	unindex_page(page);
+
+	if(class < 0)
+		return;
+
+	page->prev_indexed = NULL;
+	page->next_indexed = map->page_lists[class];
+
+	if(map->page_lists[class] != NULL)
+		map->page_lists[class]->prev_indexed = page;
+
+	map->page_lists[class] = page;
+	page->indexed_class = class;
+}
+
+//keeps the next fit rover off frames that are merged away or released
+void forget_frame(kma_frame* gone, kma_frame* replacement){
+
+	kma_map* map = map_page(gone)->map;
+
+	if(map->rover == gone)
+		map->rover = replacement;
+}
+
 
 //changes the kma_frame objects appropriately
 void allocate_frame(kma_frame* frame, int new_size){
 
+	remove_free(frame);
+
 	frame->occupied = TAKEN;
 
-	int sub_frame_size = frame_size(frame) - new_size  - sizeof(kma_frame);
+	int needed = new_size + sizeof(kma_frame);
+	int sub_frame_size = frame->size - needed;
 
-	if(sub_frame_size > 0){
+	if(sub_frame_size >= MIN_FRAME){
 		//if theres anough room to allocate another frame
-		void* sub_frame_addr = ((char*)frame) + sizeof(kma_frame) + new_size;
-		write_new_frame( sub_frame_addr, frame->page, frame, frame->next, FREE, frame->last);
-
-		//point the orginal frame to point to the new sub_frame
-		frame->next = (sub_frame_addr);
+		frame->size = needed;
 
-		//point the original next's prev to point to the new sub_frame
-		frame->next->next->prev = frame->next;
+		kma_frame* sub_frame = next_frame(frame);
+		write_frame(sub_frame, sub_frame_size, FREE, TAKEN);
 
-		//mark it as no longer the last in the chain
-		frame->last = NOT_LAST;
+		insert_free(sub_frame);
+	}else if(!last_frame_in_page(frame)){
+		//the whole frame is handed out, the next frame loses its free neighbour
+		next_frame(frame)->prev_occupied = TAKEN;
 	}
 
+	index_page(map_page(frame));
+
+}
+
+//attaches a new page after the last page of the map and returns its (free) frame
+kma_frame* add_page(kma_map* map){
+
+	kma_page_t* new_page = get_page();
+
+	kma_map_page* page = (kma_map_page*)new_page->ptr;
+	page->page = new_page;
+	page->map = map;
+	page->prev_page = map->tail;
+	page->next_page = NULL;
+	page->free_bytes = 0;
+	page->largest_free = 0;
+	page->indexed_class = -1;
+	page->zero = new_page->zero;
+
+	if(map->tail != NULL)
+		map->tail->next_page = page;
+	else
+		map->head = page;
+	map->tail = page;
+
+	//nothing comes before the first frame, so it counts its previous frame as taken
+	kma_frame* frame = page_first_frame(page);
+	write_frame(frame, PAGE_SIZE - sizeof(kma_map_page), FREE, TAKEN);
+	insert_free(frame);
+	index_page(page);
+
+	return frame;
 }
 
-bool first_frame_in_page(kma_frame* frame){
+//true when the whole page is free
+bool page_empty(kma_map_page* page){
 
-	return frame == frame->page->ptr;
+	return page->free_bytes == PAGE_SIZE - sizeof(kma_map_page);
+}
+
+//unlinks an empty page from the map and gives it back
+void release_page(kma_map_page* page){
+
+	kma_frame* frame = page_first_frame(page);
+	kma_map* map = page->map;
+
+	remove_free(frame);
+	forget_frame(frame, NULL);
+	unindex_page(page);
+
+	if(page->prev_page != NULL)
+		page->prev_page->next_page = page->next_page;
+	else
+		map->head = page->next_page;
+
+	if(page->next_page != NULL)
+		page->next_page->prev_page = page->prev_page;
+	else
+		map->tail = page->prev_page;
+
+	free_page(page->page);
 }
 
 //changes the kma_frame objects appropriately
@@ -174,164 +783,454 @@ void free_frame(kma_frame* frame){
 	//fprintf(stdout, "free: %p\n", frame);
 
 	frame->occupied = FREE;
+	map_page(frame)->zero = FALSE;
 
-	if(frame->last == NOT_LAST && frame->next->occupied == FREE && !first_frame_in_page(frame->next)){
+	//frames never span pages, so there is nothing to combine past the end of the page
+	if(!last_frame_in_page(frame) && next_frame(frame)->occupied == FREE){
 	//if theres a nextframe and its free then combine it with the current frame
-		//however, do not combine it if the next is the beginning of a page
-		//since that is how we keep track of when to free a page
 
-		//if the next frame is last, copy that last denotion over to this frame
-		frame->last = frame->next->last;
-		//combine this frame with next
-		frame->next = frame->next->next;//fix next pointer
-		frame->next->prev = frame;//fix next's previous pointer
+		kma_frame* next = next_frame(frame);
+
+		remove_free(next);
+		forget_frame(next, frame);
+
+		frame->size += next->size;
 	}
 
-	//do the same with the previous frame
-	if(frame->prev != NULL && frame->prev->occupied == FREE && !first_frame_in_page(frame)){
+	//do the same with the previous frame, found through its footer
+	if(frame->prev_occupied == FREE){
 
-		frame->prev->last = frame->last;
-		frame->prev->next = frame->next;//fix next pointer
-		frame->prev->next->prev = frame->prev;//fix next's prev pointer
+		kma_frame* prev = prev_frame(frame);
 
-		//for page-freeing purposes, set 'frame' to prev
-		frame = frame->prev;
+		remove_free(prev);
+		forget_frame(frame, prev);
 
-	}
+		prev->size += frame->size;
 
-	bool stop = FALSE;//used to detect when we are free the last page (special case)
-	while(!stop && first_frame_in_page(frame) && frame->last == LAST){
+		//for page-freeing purposes, set 'frame' to prev
+		frame = prev;
 
-		kma_page_t* temp = frame->page;
+	}
 
-		if(frame->prev == NULL){
-			stop = TRUE;
-			entry_page = NULL;
+	write_frame(frame, frame->size, FREE, frame->prev_occupied);
+	if(!last_frame_in_page(frame))
+		next_frame(frame)->prev_occupied = FREE;
 
-		}
+	insert_free(frame);
 
-		//change frame to the previous one and set it to last
-		if(frame->prev != NULL){
-			frame->prev->last = LAST;
-			frame = frame->prev;
-		}
+	//give the page back as soon as it is empty, wherever it is in the map
+	if(page_empty(map_page(frame)))
+		release_page(map_page(frame));
+	else
+		index_page(map_page(frame));
 
+}
 
-		//print_debug();
-		//need a temp since frame gets changed above but we cannot do the page free until th very last step
-		free_page(temp);
 
+//called once to set up the maps
+void init_maps(){
+
+	//the maps are empty, so this is the one point where the policy may change
+	char* policy = getenv("KMA_RM_POLICY");
+	if(policy != NULL){
+		if(strcmp(policy, "segregated") == 0)
+			rm_policy = RM_SEGREGATED_FIT;
+		else if(strcmp(policy, "first") == 0)
+			rm_policy = RM_FIRST_FIT;
+		else if(strcmp(policy, "next") == 0)
+			rm_policy = RM_NEXT_FIT;
+		else if(strcmp(policy, "best") == 0)
+			rm_policy = RM_BEST_FIT;
+		else if(strcmp(policy, "worst") == 0)
+			rm_policy = RM_WORST_FIT;
+		else if(strcmp(policy, "page") == 0)
+			rm_policy = RM_PAGE_FIT;
+		else
+			error("unknown KMA_RM_POLICY", policy);
+	}
 
+	int band, class;
+	for(band = 0; band < RM_BANDS; band++){
+		kma_map* map = &maps[band];
 
+		map->head = NULL;
+		map->tail = NULL;
+		for(class = 0; class < FREE_CLASSES; class++){
+			map->free_lists[class] = NULL;
+			map->page_lists[class] = NULL;
+		}
+		map->free_tree = NULL;
+		map->rover = NULL;
+	}
+	for(class = 0; class < FAST_BINS; class++){
+		fast_bins[class] = NULL;
 	}
-	
+	fast_count = 0;
+
+	maps_ready = TRUE;
 
 }
 
 
-//called once to set up the entry_page
-void init_first_page(){
+//a page of its own with the payload at the alignment and the tagged page object in front, for
+//requests too large for a frame
+void* big_memalign(kma_size_t alignment, kma_size_t size){
 
-	entry_page = get_page();
+	if(size > PAGE_SIZE - (int)alignment)
+		return NULL;
 
-	void* next = ((char*) entry_page->ptr) + entry_page->size;
-	write_new_frame( entry_page->ptr, entry_page, NULL, next, FREE, LAST);
+	kma_page_t* page = get_page();
+	*((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
 
+	return (char*)page->ptr + alignment;
 }
 
-
 void* kma_malloc(kma_size_t size)
 {
 
-	if(size >= PAGE_SIZE)
-		return NULL;
+	if(size > FRAME_MAX)
+		return big_memalign(sizeof(kma_page_t*), size);
+
+	if(!maps_ready)
+		init_maps();
+
+	live_count++;
+
+	//every frame must be able to hold the free list links and the footer once it
+	//is freed, and payloads are kept 8 byte aligned
+	size = (size < MIN_PAYLOAD) ? MIN_PAYLOAD : (size + 7) & ~7;
 
-	if(entry_page == NULL)
-		init_first_page();
+	//a parked frame of exactly this size is handed out as it is
+	if(size <= FAST_MAX && fast_bins[(size - MIN_PAYLOAD) / 8] != NULL){
+		kma_frame* parked = fast_bins[(size - MIN_PAYLOAD) / 8];
 
-	kma_frame* current = (kma_frame*)entry_page->ptr;
+		fast_bins[(size - MIN_PAYLOAD) / 8] = *(kma_frame**)data_ptr(parked);
+		fast_count--;
 
-	//go until last in the list or we find one that fits
-	bool fits = (current->occupied == FREE &&  frame_size(current) >= size);
-	while(current->last == NOT_LAST && !fits){
-		current = current->next;
-		fits = (current->occupied == FREE &&  frame_size(current) >= size);
+		return data_ptr(parked);
+	}
+
+	//only the map of the request's size band is looked at
+	kma_map* map = band_map(size);
+	kma_frame* current = find_free(map, size);
+
+	//parked frames may coalesce into one that fits before we take a new page
+	if(current == NULL && fast_count > 0){
+		consolidate();
+		current = find_free(map, size);
 	}
 
 	void* ret_addr;
 
 	//if it fits...
-	if(fits){
+	if(current != NULL){
 
 		allocate_frame(current,size);
 		ret_addr =  data_ptr(current);
+		map->rover = current;
 
 	//if not...
 	}else{
 
 		//if nothing in the resource map fits, we need to allocate a new page
-		//ifwe are here, current should be last
+		//and attach it after the last page of the map
+		current = add_page(map);
+
+		allocate_frame(current,size);
+		ret_addr =  data_ptr(current);
+		map->rover = current;
+	}
 
+  //print_debug();
+  return ret_addr;
+  
+}
 
-		kma_page_t* new_page = get_page();
-		void* next = ((char*) new_page->ptr) + new_page->size;
-		
- 		kma_frame* new_frame = write_new_frame(new_page->ptr, new_page, current, next, FREE, LAST);
+void kma_free(void* ptr, kma_size_t size)
+{
 
- 		allocate_frame(new_frame,size);
+	kma_frame* ptr_to_frame = (kma_frame*)ptr - 1;
 
- 		current->last = NOT_LAST;
+	//fprintf(stdout, "request, free: %p\n", ptr_to_frame);
 
- 		
- 		ret_addr =  data_ptr(new_frame);
+	//a page of its own goes straight back, it was never in a map
+	if(IS_BIG_PAGE(ptr)){
+		free_page(BIG_PAGE_OF(ptr));
+		return;
 	}
 
-  //print_debug();
-  return ret_addr;
-  
+	live_count--;
+
+	if(frame_size(ptr_to_frame) <= FAST_MAX){
+		//park small frames without coalescing, their tag still says taken so
+		//the neighbours leave them alone
+		int bin = (frame_size(ptr_to_frame) - MIN_PAYLOAD) / 8;
+
+		map_page(ptr_to_frame)->zero = FALSE;
+		*(kma_frame**)data_ptr(ptr_to_frame) = fast_bins[bin];
+		fast_bins[bin] = ptr_to_frame;
+		fast_count++;
+
+		//too much is parked, or nothing is left in use and the pages should go back
+		if(fast_count >= FAST_LIMIT || live_count == 0)
+			consolidate();
+	}else{
+		free_frame(ptr_to_frame);
+
+		if(live_count == 0 && fast_count > 0)
+			consolidate();
+	}
+	//print_debug();
+}
+
+//the frame in front of the payload knows its size, it keeps it for coalescing anyway. A page of
+//its own is told apart by the bit in its first word
+void kma_free_unsized(void* ptr)
+{
+
+	kma_free(ptr, 0);
+}
+
+//neighbours only change the occupied flags of a taken frame, never its size
+kma_size_t kma_usable_size(void* ptr)
+{
+
+	if(IS_BIG_PAGE(ptr))
+		return (char*)BASEADDR(ptr) + PAGE_SIZE - (char*)ptr;
+
+	return frame_size((kma_frame*)ptr - 1);
+}
+
+//cuts a taken frame down to a payload of size bytes if the rest is large enough to be a
+//frame of its own, the rest is freed (and merges with a free frame after it)
+void shrink_frame(kma_frame* frame, int size){
+
+	int needed = size + sizeof(kma_frame);
+	int rest_size = frame->size - needed;
+
+	if(rest_size < MIN_FRAME)
+		return;
+
+	frame->size = needed;
+
+	kma_frame* rest = next_frame(frame);
+	write_frame(rest, rest_size, TAKEN, TAKEN);
+	free_frame(rest);
 }
 
-kma_frame* get_frame(kma_frame* wanted){
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+
+	kma_frame* frame = (kma_frame*)ptr - 1;
+
+	if(IS_BIG_PAGE(ptr)){
+
+		//a page of its own keeps a request too large for a frame, it starts further in if it was aligned
+		if(new_size > FRAME_MAX && new_size <= kma_usable_size(ptr))
+			return ptr;
+
+	}else if(new_size <= FRAME_MAX){
+
+		//the same rounding as kma_malloc
+		int size = (new_size < MIN_PAYLOAD) ? MIN_PAYLOAD : (new_size + 7) & ~7;
+
+		if(size <= frame_size(frame)){
+			shrink_frame(frame, size);
+			return ptr;
+		}
+
+		//grow into the frame after this one if it is free and large enough, what is left
+		//over is cut off again
+		if(!last_frame_in_page(frame) && next_frame(frame)->occupied == FREE
+		   && frame_size(frame) + next_frame(frame)->size >= size){
 
-	kma_frame* current = first_frame();
+			kma_frame* next = next_frame(frame);
 
-	while(current != wanted){
-		current = current->next;
+			remove_free(next);
+			forget_frame(next, frame);
+
+			frame->size += next->size;
+			if(!last_frame_in_page(frame))
+				next_frame(frame)->prev_occupied = TAKEN;
+
+			shrink_frame(frame, size);
+			index_page(map_page(frame));
+
+			return ptr;
+		}
 	}
 
-	return current;
+	//copy it to a new frame or page
+	void* new_ptr = kma_malloc(new_size);
+	if(new_ptr == NULL)
+		return NULL;
+
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	kma_free(ptr, old_size);
+
+	return new_ptr;
 }
 
-void kma_free(void* ptr, kma_size_t size)
+//where the frame with an aligned payload starts in a free frame: the frame itself if its payload
+//is aligned, otherwise far enough in for what comes before to be a free frame of its own
+kma_frame* aligned_frame(kma_frame* frame, int align){
+
+	char* payload = data_ptr(frame);
+	char* aligned = (char*)(((unsigned long)payload + align - 1) & ~(unsigned long)(align - 1));
+
+	while(aligned != payload && aligned - payload < MIN_FRAME)
+		aligned += align;
+
+	return (kma_frame*)aligned - 1;
+}
+
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
 {
 
-	kma_frame* ptr_to_frame = ptr - sizeof(kma_frame);
+	if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+		return NULL;
 
-	//fprintf(stdout, "request, free: %p\n", ptr_to_frame);
+	if(alignment <= 8)
+		return kma_malloc(size);
 
-	free_frame(ptr_to_frame);
-	//print_debug();
+	if(size > FRAME_MAX)
+		return big_memalign(alignment, size);
+
+	if(!maps_ready)
+		init_maps();
+
+	//the same rounding as kma_malloc
+	size = (size < MIN_PAYLOAD) ? MIN_PAYLOAD : (size + 7) & ~7;
+
+	//the frame malloc would pick may have room for the aligned payload, every free frame
+	//of the padded size has room for it and a free frame in front of it
+	int padded = size + alignment + MIN_FRAME;
+
+	kma_map* map = band_map(size);
+	kma_frame* current = find_free(map, size);
+
+	if(current != NULL && (char*)data_ptr(aligned_frame(current, alignment)) + size > (char*)current + current->size)
+		current = find_free(map, padded);
+
+	if(current == NULL && fast_count > 0){
+		consolidate();
+		current = find_free(map, padded);
+	}
+
+	if(current == NULL)
+		current = add_page(map);
+
+	kma_frame* aligned = aligned_frame(current, alignment);
+
+	//only a new page can be too small, the alignment puts the payload too close to its end.
+	//The request gets a page of its own instead
+	if((char*)data_ptr(aligned) + size > (char*)current + current->size){
+		release_page(map_page(current));
+		return big_memalign(alignment, size);
+	}
+
+	live_count++;
+
+	//the part before the aligned payload is split off and stays free, allocate_frame cuts
+	//off the part after it
+	if(aligned != current){
+		int gap = (char*)aligned - (char*)current;
+
+		remove_free(current);
+		write_frame(aligned, current->size - gap, FREE, FREE);
+		write_frame(current, gap, FREE, current->prev_occupied);
+		insert_free(current);
+		insert_free(aligned);
+		map_page(current)->zero = FALSE;
+	}
+
+	allocate_frame(aligned, size);
+	map->rover = aligned;
+
+	return data_ptr(aligned);
 }
 
-void print_debug(){
+//a frame cut from the front of the last frame of a page that came zeroed, before any frame of
+//the page was freed, is zero but for the free list links at its start and, if it runs to the
+//end of the page, the footer in its last 8 bytes
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+
+	//nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+	//which together keep count * size from overflowing
+	if(count <= 0 || size <= 0 || (long)count * size > PAGE_SIZE)
+		return NULL;
 
-	kma_frame* current = first_frame();
+	size *= count;
 
+	void* ptr = kma_malloc(size);
 
-	while(current->last != LAST){
-		fprintf(stdout, "frame: %p, page: %p, prev: %p, next: %p, occupied: %x, last: %x, \n",
-				 current, current->page, current->prev, current->next, current->occupied, current->last);
+	if(ptr == NULL)
+		return NULL;
+
+	if(IS_BIG_PAGE(ptr)){
+		if(!BIG_PAGE_OF(ptr)->zero)
+			memset(ptr, 0, size);
 
-				
-		current = current->next;
+		return ptr;
 	}
 
-			fprintf(stdout, "frame: %p, page: %p, prev: %p, next: %p, occupied: %x, last: %x, \n",
-				 current, current->page, current->prev, current->next, current->occupied, current->last);
+	kma_frame* frame = (kma_frame*)ptr - 1;
 
-	fprintf(stdout, "================================================\n");
+	if(map_page(frame)->zero){
+		memset(ptr, 0, sizeof(kma_free_links));
+		memset((char*)frame + frame->size - sizeof(kma_frame), 0, sizeof(kma_frame));
+	}else{
+		memset(ptr, 0, size);
+	}
 
+	return ptr;
+}
+
+//frees every parked frame for real, coalescing it with its neighbours
+void consolidate(){
+
+	int bin;
+
+	for(bin = 0; bin < FAST_BINS; bin++){
+		while(fast_bins[bin] != NULL){
+			kma_frame* parked = fast_bins[bin];
+
+			fast_bins[bin] = *(kma_frame**)data_ptr(parked);
+			free_frame(parked);
+		}
+	}
+
+	fast_count = 0;
+}
+
+void print_debug(){
 
+	kma_map_page* page;
+	int band;
+
+	for(band = 0; band < RM_BANDS; band++){
+		fprintf(stdout, "map %d\n", band);
+
+		for(page = maps[band].head; page != NULL; page = page->next_page){
+			fprintf(stdout, "page: %p, prev: %p, next: %p, free bytes: %d, largest free: %d\n",
+					 page, page->prev_page, page->next_page, page->free_bytes, page->largest_free);
+
+			kma_frame* current = page_first_frame(page);
+
+			while(!last_frame_in_page(current)){
+				fprintf(stdout, "  frame: %p, size: %d, occupied: %x, prev occupied: %x\n",
+					 current, current->size, current->occupied, current->prev_occupied);
+
+				current = next_frame(current);
+			}
+
+			fprintf(stdout, "  frame: %p, size: %d, occupied: %x, prev occupied: %x\n",
+				 current, current->size, current->occupied, current->prev_occupied);
+		}
+	}
+
+	fprintf(stdout, "================================================\n");
 
 }
 
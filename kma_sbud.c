@@ -0,0 +1,665 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Kernel memory allocator based on buddy systems with finer
+ *             block sizes (weighted and Fibonacci buddies)
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.2  2009/10/31 21:28:52  jot836
+ *    This is the current version of KMA project 3.
+ *    It includes:
+ *    - the most up-to-date handout (F'09)
+ *    - updated skeleton including
+ *        file-driven test harness,
+ *        trace generator script,
+ *        support for evaluating efficiency of algorithm (wasted memory),
+ *        gnuplot support for plotting allocation and waste,
+ *        set of traces for all students to use (including a makefile and README of the settings),
+ *    - different version of the testsuite for use on the submission site, including:
+ *        scoreboard Python scripts, which posts the top 5 scores on the course webpage
+ *
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ *    Revision 1.2  2004/11/05 15:45:56  sbirrer
+ *    - added size as a parameter to kma_free
+ *
+ *    Revision 1.1  2004/11/03 23:04:03  sbirrer
+ *    - initial version for the kernel memory allocator project
+ *
+ ***************************************************************************/
+#ifdef KMA_SBUD
+#define __KMA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+ //block size series, picked with -DBUD_SERIES
+ #define BUD_BINARY 0//2^k, split in halves
+ #define BUD_WEIGHTED 1//2^k and 3*2^k, split 3:1 and 2:1 (Shen and Peterson)
+ #define BUD_FIBONACCI 2//each size the sum of the two below it, split into those two
+
+ #ifndef BUD_SERIES
+ #define BUD_SERIES BUD_FIBONACCI
+ #endif
+
+ //block sizes are counted in units of 8 bytes
+ #define UNIT 8
+
+ //every page starts with a pointer to its kma_page_t and its number of free units, the root
+ //blocks follow. The header is padded so that payloads can be aligned (kma_memalign): with 16
+ //the payloads of the binary and weighted series, whose blocks all start an even number of
+ //units in, would never be more than 8 byte aligned. Their first payload starts a cache line
+ //into the page. The Fibonacci series has blocks at odd offsets too, and a cache line would
+ //cost it the 34 unit root, so its first payload is only 32 byte aligned
+ #if BUD_SERIES == BUD_FIBONACCI
+ #define PAGE_HEADER 24
+ #else
+ #define PAGE_HEADER 56
+ #endif
+ #define PAGE_UNITS ((PAGESIZE - PAGE_HEADER) / UNIT)
+
+ //a page of its own starts with its page object too, with the lowest bit set to tell it
+ //from a page of blocks (page objects come from malloc, so the bit is otherwise 0)
+ #define BIG_PAGE_BIT 1L
+ #define IS_BIG_PAGE(ptr) (*(long*)BASEADDR(ptr) & BIG_PAGE_BIT)
+ #define BIG_PAGE_OF(ptr) ((kma_page_t*)(*(long*)BASEADDR(ptr) & ~BIG_PAGE_BIT))
+
+ //smallest block, a free block holds its tag and its list links
+ #define MIN_UNITS 3
+
+ //number of free blocks of each class kma_memalign looks at before it takes a new page
+ #define ALIGN_SEARCH 16
+
+ #define MAX_CLASSES 32
+ #define MAX_ROOTS 16
+
+ //where a block sits in its parent
+ #define SIDE_ROOT 0
+ #define SIDE_LEFT 1
+ #define SIDE_RIGHT 2
+
+typedef struct bud_tag bud_tag;
+
+//in front of every block, allocated or free. With blocks of unequal sizes the buddy can't be
+//found by flipping an address bit, so every block says which side of its parent it is on
+struct bud_tag
+{
+  unsigned char index;//size class of the block
+  unsigned char free;
+  unsigned char side;//SIDE_ROOT, SIDE_LEFT or SIDE_RIGHT
+  unsigned char sibling;//right blocks: size class of the left buddy
+  //while a block is split its own side and sibling would be lost, so the left half keeps
+  //them and the right half keeps what the block itself was keeping (Cranston and Thomas)
+  unsigned char stash_side;
+  unsigned char stash_sibling;
+  short unused;
+};
+
+typedef struct bud_links bud_links;
+
+//lives after the tag of every free block
+struct bud_links
+{
+  bud_tag* prev_free;
+  bud_tag* next_free;
+};
+
+typedef struct
+{
+  kma_page_t* page;
+  int free_units;//units in free blocks of this page
+  int unused;
+} bud_page;
+
+/************Global Variables*********************************************/
+
+//size of every class in units, ascending
+int sizes[MAX_CLASSES];
+int num_classes = 0;
+
+//classes of the two halves of a block, -1 if it isn't split
+int left_of[MAX_CLASSES];
+int right_of[MAX_CLASSES];
+
+//class of the block a left half came from
+int parent_of_left[MAX_CLASSES];
+
+//smallest class of at least n units
+unsigned char class_of[PAGE_UNITS + 1];
+
+//every page is covered by the same root blocks, largest first
+int root_class[MAX_ROOTS];
+int root_offset[MAX_ROOTS];
+int num_roots = 0;
+int root_units = 0;
+
+//largest request served from a block, larger ones get a page of their own
+int max_payload;
+
+bud_tag* free_heads[MAX_CLASSES];
+
+//bit i is set when free_heads[i] isn't empty
+unsigned int free_map = 0;
+
+bool series_ready = FALSE;
+
+/************Function Prototypes******************************************/
+void init_series();
+int class_index(int units);
+void insert_block(bud_tag* tag);
+void remove_block(bud_tag* tag);
+void split_block(bud_tag* tag);
+void new_page();
+void release_page(bud_page* page);
+void* big_malloc(kma_size_t size);
+void* big_memalign(kma_size_t alignment, kma_size_t size);
+void free_block(bud_tag* tag);
+int aligned_block(int index, int offset, int need, int align, int* found);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+//class of a size in units, -1 if it isn't in the series
+int class_index(int units)
+{
+  int i;
+
+  for(i = 0; i < num_classes; i++)
+    if(sizes[i] == units)
+      return i;
+
+  return -1;
+}
+
+//builds the size series, how each size splits, and the root blocks of a page
+void init_series()
+{
+  int i, n;
+
+#if BUD_SERIES == BUD_BINARY
+  for(n = 4; n <= PAGE_UNITS; n *= 2)
+    sizes[num_classes++] = n;
+#elif BUD_SERIES == BUD_WEIGHTED
+  //6 units would only come from splitting 8 into 6 and 2, and 2 units can't hold the tag and
+  //links of a free block, so the series starts 4, 8, 12
+  for(n = 4; n <= PAGE_UNITS; n *= 2){
+    sizes[num_classes++] = n;
+    if(n > 4 && n * 3 / 2 <= PAGE_UNITS)
+      sizes[num_classes++] = n * 3 / 2;
+  }
+#else
+  sizes[num_classes++] = MIN_UNITS;
+  sizes[num_classes++] = 5;
+  while(sizes[num_classes - 1] + sizes[num_classes - 2] <= PAGE_UNITS){
+    sizes[num_classes] = sizes[num_classes - 1] + sizes[num_classes - 2];
+    num_classes++;
+  }
+#endif
+
+  for(i = 0; i < num_classes; i++){
+    int left = -1, right = -1;
+
+#if BUD_SERIES == BUD_BINARY
+    left = right = class_index(sizes[i] / 2);
+#elif BUD_SERIES == BUD_WEIGHTED
+    //2^k splits into 3*2^(k-2) and 2^(k-2), 3*2^k into 2^(k+1) and 2^k
+    if((sizes[i] & (sizes[i] - 1)) == 0){
+      left = class_index(sizes[i] / 4 * 3);
+      right = class_index(sizes[i] / 4);
+    }else{
+      left = class_index(sizes[i] / 3 * 2);
+      right = class_index(sizes[i] / 3);
+    }
+#else
+    if(i >= 2){
+      left = i - 1;
+      right = i - 2;
+    }
+#endif
+
+    //a block is only split if both halves can be blocks
+    if(left < 0 || right < 0)
+      left = right = -1;
+    else
+      parent_of_left[left] = i;
+
+    left_of[i] = left;
+    right_of[i] = right;
+  }
+
+  for(n = 0, i = 0; n <= PAGE_UNITS; n++){
+    while(i < num_classes - 1 && sizes[i] < n)
+      i++;
+    class_of[n] = i;
+  }
+
+  //cover the page greedily with the largest blocks that still fit
+  int offset = 0;
+  for(i = num_classes - 1; i >= 0; i--){
+    while(offset + sizes[i] <= PAGE_UNITS && num_roots < MAX_ROOTS){
+      root_class[num_roots] = i;
+      root_offset[num_roots] = offset;
+      num_roots++;
+      offset += sizes[i];
+    }
+  }
+  root_units = offset;
+
+  max_payload = sizes[root_class[0]] * UNIT - sizeof(bud_tag);
+
+  series_ready = TRUE;
+}
+
+bud_links* links(bud_tag* tag)
+{
+  return (bud_links*)(tag + 1);
+}
+
+bud_tag* tag_at(bud_tag* tag, int units)
+{
+  return (bud_tag*)((char*)tag + units * UNIT);
+}
+
+//marks a block free and pushes it on the list of its class
+void insert_block(bud_tag* tag)
+{
+  int i = tag->index;
+
+  tag->free = TRUE;
+  links(tag)->prev_free = NULL;
+  links(tag)->next_free = free_heads[i];
+  if(free_heads[i] != NULL)
+    links(free_heads[i])->prev_free = tag;
+  free_heads[i] = tag;
+
+  free_map |= 1U << i;
+  ((bud_page*)BASEADDR(tag))->free_units += sizes[i];
+}
+
+void remove_block(bud_tag* tag)
+{
+  int i = tag->index;
+  bud_links* block_links = links(tag);
+
+  if(block_links->prev_free != NULL)
+    links(block_links->prev_free)->next_free = block_links->next_free;
+  else
+    free_heads[i] = block_links->next_free;
+
+  if(block_links->next_free != NULL)
+    links(block_links->next_free)->prev_free = block_links->prev_free;
+
+  if(free_heads[i] == NULL)
+    free_map &= ~(1U << i);
+
+  tag->free = FALSE;
+  ((bud_page*)BASEADDR(tag))->free_units -= sizes[i];
+}
+
+//turns a block (on no list) into its two halves (on no list either)
+void split_block(bud_tag* tag)
+{
+  bud_tag parent = *tag;
+  int left = left_of[parent.index];
+  bud_tag* right_tag = tag_at(tag, sizes[left]);
+
+  tag->index = left;
+  tag->side = SIDE_LEFT;
+  tag->stash_side = parent.side;
+  tag->stash_sibling = parent.sibling;
+
+  right_tag->index = right_of[parent.index];
+  right_tag->free = FALSE;
+  right_tag->side = SIDE_RIGHT;
+  right_tag->sibling = left;
+  right_tag->stash_side = parent.stash_side;
+  right_tag->stash_sibling = parent.stash_sibling;
+}
+
+//takes a new page and puts its root blocks on the free lists
+void new_page()
+{
+  kma_page_t* kpage = get_page();
+  bud_page* page = (bud_page*)kpage->ptr;
+  int i;
+
+  page->page = kpage;
+  page->free_units = 0;
+
+  for(i = 0; i < num_roots; i++){
+    bud_tag* tag = (bud_tag*)((char*)page + PAGE_HEADER + root_offset[i] * UNIT);
+
+    tag->index = root_class[i];
+    tag->side = SIDE_ROOT;
+    insert_block(tag);
+  }
+}
+
+//the page is all free, take its root blocks off the lists and give it back
+void release_page(bud_page* page)
+{
+  int i;
+
+  for(i = 0; i < num_roots; i++)
+    remove_block((bud_tag*)((char*)page + PAGE_HEADER + root_offset[i] * UNIT));
+
+  free_page(page->page);
+}
+
+//requests too big for a root block get a page of their own, the page object goes in front
+void* big_malloc(kma_size_t size)
+{
+  if(size > PAGESIZE - (int)sizeof(kma_page_t*))
+    return NULL;
+
+  kma_page_t* page = get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + sizeof(kma_page_t*);
+}
+
+//a page of its own with the payload at the alignment and the page object in front, for large
+//aligned requests and for small ones no block of a page can be split to
+void* big_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(size > PAGESIZE - (int)alignment)
+    return NULL;
+
+  kma_page_t* page = get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + alignment;
+}
+
+void* kma_malloc(kma_size_t size)
+{
+  if(!series_ready)
+    init_series();
+
+  if(size > max_payload)
+    return big_malloc(size);
+
+  int need = (size + sizeof(bud_tag) + UNIT - 1) / UNIT;
+  if(need < MIN_UNITS)
+    need = MIN_UNITS;
+
+  unsigned int map = free_map & (~0U << class_of[need]);
+
+  if(map == 0){
+    new_page();
+    map = free_map & (~0U << class_of[need]);
+  }
+
+  bud_tag* tag = free_heads[__builtin_ctz(map)];
+  remove_block(tag);
+
+  //split down to the smallest block that fits, freeing the half that isn't used
+  while(left_of[tag->index] >= 0){
+    int left = left_of[tag->index];
+    int right = right_of[tag->index];
+
+    if(sizes[right] >= need){
+      split_block(tag);
+      insert_block(tag);
+      tag = tag_at(tag, sizes[left]);
+    }else if(sizes[left] >= need){
+      split_block(tag);
+      insert_block(tag_at(tag, sizes[left]));
+    }else{
+      break;
+    }
+  }
+
+  return tag + 1;
+}
+
+//frees a block and merges it with its buddies, the page goes back once it is all free again
+void free_block(bud_tag* tag)
+{
+  //merge with the buddy as long as it is free and not split itself. The buddy's address is
+  //a block start either way, so its tag can be read
+  while(tag->side != SIDE_ROOT){
+    bud_tag* left;
+    bud_tag* right;
+    int buddy_index;
+
+    if(tag->side == SIDE_LEFT){
+      left = tag;
+      right = tag_at(tag, sizes[tag->index]);
+      buddy_index = right_of[parent_of_left[tag->index]];
+    }else{
+      left = tag_at(tag, -sizes[tag->sibling]);
+      right = tag;
+      buddy_index = tag->sibling;
+    }
+
+    bud_tag* buddy = (tag == left) ? right : left;
+
+    if(!buddy->free || buddy->index != buddy_index)
+      break;
+
+    remove_block(buddy);
+
+    left->index = parent_of_left[left->index];
+    left->side = left->stash_side;
+    left->sibling = left->stash_sibling;
+    left->stash_side = right->stash_side;
+    left->stash_sibling = right->stash_sibling;
+
+    tag = left;
+  }
+
+  insert_block(tag);
+
+  bud_page* page = (bud_page*)BASEADDR(tag);
+  if(page->free_units == root_units)
+    release_page(page);
+}
+
+//a small block of kma_memalign can have a page of its own too
+void kma_free(void* ptr, kma_size_t size)
+{
+  if(size > max_payload || IS_BIG_PAGE(ptr))
+    free_page(BIG_PAGE_OF(ptr));
+  else
+    free_block((bud_tag*)ptr - 1);
+}
+
+//a block's tag has its class, a page of its own is told apart by the bit in its first word
+void kma_free_unsized(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    free_page(BIG_PAGE_OF(ptr));
+  else
+    free_block((bud_tag*)ptr - 1);
+}
+
+//merges and splits of other blocks only read the tag of a used block
+kma_size_t kma_usable_size(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    return PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr));
+
+  return sizes[((bud_tag*)ptr - 1)->index] * UNIT - sizeof(bud_tag);
+}
+
+//the block stays if malloc would have picked one of its size for the new size (it fits and
+//neither of its halves does), otherwise it is copied
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  bool big = IS_BIG_PAGE(ptr);
+
+  //the payload of a page of its own starts further in if it was aligned
+  if(big && new_size > max_payload && new_size <= PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr)))
+    return ptr;
+
+  if(!big && new_size <= max_payload){
+    bud_tag* tag = (bud_tag*)ptr - 1;
+    int need = (new_size + sizeof(bud_tag) + UNIT - 1) / UNIT;
+    int left = left_of[tag->index];
+    int right = right_of[tag->index];
+
+    if(sizes[tag->index] >= need && (left < 0 || (sizes[left] < need && sizes[right] < need)))
+      return ptr;
+  }
+
+  void* new_ptr = kma_malloc(new_size);
+  if(new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+//the smallest block that splitting the block of this class at this offset (in units from the
+//first root) can make, which holds need units and whose payload is aligned. Returns its offset
+//and puts its class in found, or returns -1 if there is none
+int aligned_block(int index, int offset, int need, int align, int* found)
+{
+  int best = -1;
+
+  if(sizes[index] < need)
+    return -1;
+
+  if(left_of[index] >= 0){
+    int left = left_of[index];
+    int left_found, right_found;
+    int left_offset = aligned_block(left, offset, need, align, &left_found);
+    int right_offset = aligned_block(right_of[index], offset + sizes[left], need, align, &right_found);
+
+    if(left_offset >= 0){
+      best = left_offset;
+      *found = left_found;
+    }
+    if(right_offset >= 0 && (best < 0 || sizes[right_found] < sizes[*found])){
+      best = right_offset;
+      *found = right_found;
+    }
+  }
+
+  //a left half starts where its block does, so it was found above if it fits
+  if(best < 0 && (PAGE_HEADER + offset * UNIT + sizeof(bud_tag)) % align == 0){
+    best = offset;
+    *found = index;
+  }
+
+  return best;
+}
+
+//the first ALIGN_SEARCH free blocks of every class large enough are searched for the smallest
+//block splitting them can make whose payload is aligned, then the roots of a new page. The
+//block is split down to that one, which is then freed like any other
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+
+  if(alignment <= 8)
+    return kma_malloc(size);
+
+  if(!series_ready)
+    init_series();
+
+  if(size > max_payload)
+    return big_memalign(alignment, size);
+
+  int need = (size + sizeof(bud_tag) + UNIT - 1) / UNIT;
+  if(need < MIN_UNITS)
+    need = MIN_UNITS;
+
+  bud_tag* tag = NULL;
+  int target = -1, target_index = 0, i, searched;
+
+  for(i = class_of[need]; i < num_classes && target < 0; i++){
+    tag = free_heads[i];
+
+    for(searched = 0; tag != NULL && searched < ALIGN_SEARCH; searched++){
+      target = aligned_block(i, ((char*)tag - (char*)BASEADDR(tag) - PAGE_HEADER) / UNIT,
+                             need, alignment, &target_index);
+      if(target >= 0)
+        break;
+
+      tag = links(tag)->next_free;
+    }
+  }
+
+  if(target < 0){
+    new_page();
+
+    //a root of the new page is first on its list
+    char* page = BASEADDR(free_heads[root_class[0]]);
+
+    for(i = 0; i < num_roots && target < 0; i++){
+      tag = (bud_tag*)(page + PAGE_HEADER + root_offset[i] * UNIT);
+      target = aligned_block(root_class[i], root_offset[i], need, alignment, &target_index);
+    }
+
+    //no block boundary of a page is aligned to that, the page is still all free. The request
+    //gets a page of its own instead
+    if(target < 0){
+      release_page((bud_page*)BASEADDR(tag));
+      return big_memalign(alignment, size);
+    }
+  }
+
+  bud_tag* target_tag = (bud_tag*)((char*)BASEADDR(tag) + PAGE_HEADER + target * UNIT);
+
+  //split down to the target, freeing the halves it isn't in
+  remove_block(tag);
+  while(tag != target_tag || tag->index != target_index){
+    split_block(tag);
+
+    bud_tag* right_tag = tag_at(tag, sizes[tag->index]);
+
+    if(target_tag >= right_tag){
+      insert_block(tag);
+      tag = right_tag;
+    }else{
+      insert_block(right_tag);
+    }
+  }
+
+  return tag + 1;
+}
+
+//blocks keep their tags and free list links in the memory around and inside them, so only a
+//page of its own can be known to be zero
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+  //nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+  //which together keep count * size from overflowing
+  if(count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    return NULL;
+
+  size *= count;
+
+  void* ptr = kma_malloc(size);
+
+  if(ptr != NULL && (size <= max_payload || !BIG_PAGE_OF(ptr)->zero))
+    memset(ptr, 0, size);
+
+  return ptr;
+}
+
+#endif // KMA_SBUD
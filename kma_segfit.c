@@ -0,0 +1,499 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Kernel memory allocator based on bins of finely spaced size
+ *             classes, each served from one page runs with a bit map
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.2  2009/10/31 21:28:52  jot836
+ *    This is the current version of KMA project 3.
+ *    It includes:
+ *    - the most up-to-date handout (F'09)
+ *    - updated skeleton including
+ *        file-driven test harness,
+ *        trace generator script,
+ *        support for evaluating efficiency of algorithm (wasted memory),
+ *        gnuplot support for plotting allocation and waste,
+ *        set of traces for all students to use (including a makefile and README of the settings),
+ *    - different version of the testsuite for use on the submission site, including:
+ *        scoreboard Python scripts, which posts the top 5 scores on the course webpage
+ *
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ *    Revision 1.2  2004/11/05 15:45:56  sbirrer
+ *    - added size as a parameter to kma_free
+ *
+ *    Revision 1.1  2004/11/03 23:04:03  sbirrer
+ *    - initial version for the kernel memory allocator project
+ *
+ ***************************************************************************/
+#ifdef KMA_SEGFIT
+#define __KMA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+ //size classes are 16 byte steps up to 128 (8 classes), then 4 classes per power of 2 up to 896
+ #define QUANTUM 16
+ #define QUANTUM_MAX 128
+ #define QUANTUM_CLASSES (QUANTUM_MAX / QUANTUM)
+ #define QUARTER_MAX 896
+ #define QUARTER_CLASSES (QUANTUM_CLASSES + 11)
+
+ //a run is a single page, so above QUARTER_MAX quarter steps would leave up to a quarter of
+ //the run unused. The classes there are the largest sizes that fit 7, 6, 5, 4, 3 and 2 objects
+ #define FIT_MAX_OBJECTS 7
+ #define NUM_CLASSES (QUARTER_CLASSES + FIT_MAX_OBJECTS - 1)
+
+ //largest size class, requests above it get a page of their own
+ #define SMALL_MAX (((PAGESIZE - (int)RUN_HEADER) / 2) & ~(QUANTUM - 1))
+
+ //one bit per object of the smallest class
+ #define MAP_WORDS ((PAGESIZE / QUANTUM + 63) / 64)
+
+typedef struct segfit_run segfit_run;
+
+//a run is one page cut into objects of a single class. This header sits at the start
+//of the page, the objects follow it
+struct segfit_run
+{
+  kma_page_t* page;//the page object to hand back to free_page
+  segfit_run* prev;//neighbours on the bin's list of runs with free objects
+  segfit_run* next;
+  int free_count;//number of free objects
+  int fresh;//objects from this one on were never handed out, on a page that came zeroed they
+            //still are zero (nothing is stored in a free object). per_run if the page didn't
+  int class;//index of the bin, for kma_free_unsized
+  unsigned long long free_map[MAP_WORDS];//bit i is set when object i is free
+};
+
+ #define CACHE_LINE 64
+
+ //offset of the first object of a run, a whole number of cache lines so that an object
+ //is aligned to up to a cache line wherever its size lets it be
+ #define RUN_HEADER ((sizeof(segfit_run) + CACHE_LINE - 1) & ~(CACHE_LINE - 1))
+
+ //returns the run an object lives in
+ #define RUN_OF(ptr) ((segfit_run*)BASEADDR(ptr))
+
+ //a page of its own starts with its page object like a run does, with the lowest bit set
+ //to tell the two apart (page objects come from malloc, so the bit is otherwise 0)
+ #define BIG_PAGE_BIT 1L
+ #define IS_BIG_PAGE(ptr) (*(long*)BASEADDR(ptr) & BIG_PAGE_BIT)
+ #define BIG_PAGE_OF(ptr) ((kma_page_t*)(*(long*)BASEADDR(ptr) & ~BIG_PAGE_BIT))
+
+typedef struct
+{
+  segfit_run* current;//the run allocations come from
+  segfit_run* nonfull;//other runs with free objects
+  int size;//object size
+  int per_run;//number of objects in a run
+} segfit_bin;
+
+/************Global Variables*********************************************/
+
+segfit_bin bins[NUM_CLASSES];
+
+bool bins_ready = FALSE;
+
+/************Function Prototypes******************************************/
+int size_class(kma_size_t size);
+void init_bins();
+segfit_run* new_run(segfit_bin* bin);
+void push_run(segfit_bin* bin, segfit_run* run);
+void unlink_run(segfit_bin* bin, segfit_run* run);
+void* big_malloc(kma_size_t size);
+void* big_memalign(kma_size_t alignment, kma_size_t size);
+void free_object(segfit_bin* bin, void* ptr);
+segfit_run* current_run(segfit_bin* bin);
+int lowest_free(segfit_run* run);
+void* take_object(segfit_bin* bin, segfit_run* run, int index);
+int aligned_object(segfit_bin* bin, segfit_run* run, int first, int step);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+//size class of a request of at most SMALL_MAX bytes, no table needed
+int size_class(kma_size_t size)
+{
+  if(size <= QUANTUM_MAX)
+    return (size <= 0) ? 0 : (size - 1) / QUANTUM;
+
+  if(size <= QUARTER_MAX){
+    //the top 3 bits of size - 1 pick the power of 2 and the quarter within it
+    int x = size - 1;
+    int log2 = 31 - __builtin_clz(x);
+
+    return QUANTUM_CLASSES + (log2 - 7) * 4 + (x >> (log2 - 2)) - 4;
+  }
+
+  //at most FIT_MAX_OBJECTS - 1 steps
+  int class = QUARTER_CLASSES;
+  while(bins[class].size < size)
+    class++;
+
+  return class;
+}
+
+//works out the object size and objects per run of every class
+void init_bins()
+{
+  int class;
+
+  for(class = 0; class < NUM_CLASSES; class++){
+    segfit_bin* bin = &bins[class];
+
+    if(class < QUANTUM_CLASSES){
+      bin->size = (class + 1) * QUANTUM;
+    }else if(class < QUARTER_CLASSES){
+      int group = (class - QUANTUM_CLASSES) / 4;
+      int quarter = (class - QUANTUM_CLASSES) % 4;
+
+      bin->size = (QUANTUM_MAX << group) + (quarter + 1) * (QUANTUM_MAX / 4 << group);
+    }else{
+      int objects = FIT_MAX_OBJECTS - (class - QUARTER_CLASSES);
+
+      bin->size = ((PAGESIZE - RUN_HEADER) / objects) & ~(QUANTUM - 1);
+    }
+
+    bin->per_run = (PAGESIZE - RUN_HEADER) / bin->size;
+    bin->current = NULL;
+    bin->nonfull = NULL;
+  }
+
+  bins_ready = TRUE;
+}
+
+//takes a new page and marks all of its objects free
+segfit_run* new_run(segfit_bin* bin)
+{
+  kma_page_t* page = get_page();
+  segfit_run* run = (segfit_run*)page->ptr;
+  int i;
+
+  run->page = page;
+  run->prev = NULL;
+  run->next = NULL;
+  run->free_count = bin->per_run;
+  run->fresh = page->zero ? 0 : bin->per_run;
+  run->class = bin - bins;
+
+  for(i = 0; i < MAP_WORDS; i++){
+    int bits = bin->per_run - i * 64;
+
+    if(bits >= 64)
+      run->free_map[i] = ~0ULL;
+    else if(bits > 0)
+      run->free_map[i] = (1ULL << bits) - 1;
+    else
+      run->free_map[i] = 0;
+  }
+
+  return run;
+}
+
+void push_run(segfit_bin* bin, segfit_run* run)
+{
+  run->prev = NULL;
+  run->next = bin->nonfull;
+  if(bin->nonfull != NULL)
+    bin->nonfull->prev = run;
+  bin->nonfull = run;
+}
+
+void unlink_run(segfit_bin* bin, segfit_run* run)
+{
+  if(run->prev != NULL)
+    run->prev->next = run->next;
+  else
+    bin->nonfull = run->next;
+
+  if(run->next != NULL)
+    run->next->prev = run->prev;
+}
+
+//requests above SMALL_MAX get a page of their own, the page object goes in front
+void* big_malloc(kma_size_t size)
+{
+  if(size > PAGESIZE - (int)sizeof(kma_page_t*))
+    return NULL;
+
+  kma_page_t* page = get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + sizeof(kma_page_t*);
+}
+
+//a page of its own with the payload at the alignment and the page object in front, for large
+//aligned requests and for small ones no block can be aligned for
+void* big_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(size > PAGESIZE - (int)alignment)
+    return NULL;
+
+  kma_page_t* page = get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + alignment;
+}
+
+//the run objects of the bin come from, with at least one free object
+segfit_run* current_run(segfit_bin* bin)
+{
+  segfit_run* run = bin->current;
+
+  //a full current run is on no list, it goes back on nonfull when one of its objects is freed
+  if(run == NULL || run->free_count == 0){
+    run = bin->nonfull;
+
+    if(run != NULL)
+      unlink_run(bin, run);
+    else
+      run = new_run(bin);
+
+    bin->current = run;
+  }
+
+  return run;
+}
+
+//lowest free object of the run, so objects are handed out in address order
+int lowest_free(segfit_run* run)
+{
+  int word = 0;
+  while(run->free_map[word] == 0)
+    word++;
+
+  return word * 64 + __builtin_ctzll(run->free_map[word]);
+}
+
+//marks a free object of the run in use and returns it
+void* take_object(segfit_bin* bin, segfit_run* run, int index)
+{
+  run->free_map[index / 64] &= ~(1ULL << (index % 64));
+  run->free_count--;
+
+  if(index >= run->fresh)
+    run->fresh = index + 1;
+
+  return (char*)run + RUN_HEADER + index * bin->size;
+}
+
+void* kma_malloc(kma_size_t size)
+{
+  if(size > SMALL_MAX)
+    return big_malloc(size);
+
+  if(!bins_ready)
+    init_bins();
+
+  segfit_bin* bin = &bins[size_class(size)];
+  segfit_run* run = current_run(bin);
+
+  return take_object(bin, run, lowest_free(run));
+}
+
+//gives an object back to its run, whose page goes back once all of its objects are free
+void free_object(segfit_bin* bin, void* ptr)
+{
+  segfit_run* run = RUN_OF(ptr);
+  int index = ((char*)ptr - ((char*)run + RUN_HEADER)) / bin->size;
+
+  assert(!(run->free_map[index / 64] & (1ULL << (index % 64))));
+
+  run->free_map[index / 64] |= 1ULL << (index % 64);
+  run->free_count++;
+
+  if(run->free_count == bin->per_run){
+    //the run is empty, give its page back
+    if(run == bin->current)
+      bin->current = NULL;
+    else
+      unlink_run(bin, run);
+
+    free_page(run->page);
+  }else if(run->free_count == 1 && run != bin->current){
+    //the run was full
+    push_run(bin, run);
+  }
+}
+
+//nothing is stored with an object, its size gives the class and its address the run. A small
+//object of kma_memalign can have a page of its own too
+void kma_free(void* ptr, kma_size_t size)
+{
+  if(size > SMALL_MAX || IS_BIG_PAGE(ptr)){
+    free_page(BIG_PAGE_OF(ptr));
+    return;
+  }
+
+  free_object(&bins[size_class(size)], ptr);
+}
+
+//the run keeps its class, a page of its own is told apart by the bit in its first word
+void kma_free_unsized(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr)){
+    free_page(BIG_PAGE_OF(ptr));
+    return;
+  }
+
+  free_object(&bins[RUN_OF(ptr)->class], ptr);
+}
+
+kma_size_t kma_usable_size(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    return PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr));
+
+  return bins[RUN_OF(ptr)->class].size;
+}
+
+//an object stays where it is if the new size is of the same class, otherwise it is copied
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  bool big = IS_BIG_PAGE(ptr);
+
+  //the payload of a page of its own starts further in if it was aligned
+  if(big && new_size > SMALL_MAX && new_size <= PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr)))
+    return ptr;
+
+  if(!big && new_size <= SMALL_MAX && size_class(old_size) == size_class(new_size))
+    return ptr;
+
+  void* new_ptr = kma_malloc(new_size);
+  if(new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+//index of a free object of the run among first, first + step, first + 2 * step, ... or -1
+int aligned_object(segfit_bin* bin, segfit_run* run, int first, int step)
+{
+  int i;
+
+  for(i = first; i < bin->per_run; i += step){
+    if(run->free_map[i / 64] & (1ULL << (i % 64)))
+      return i;
+  }
+
+  return -1;
+}
+
+//an aligned object is one of the objects of its size class whose address happens to be
+//aligned, so nothing is wasted and kma_free finds it the usual way. They come every step
+//objects, from the current run, another run with free objects or a new run
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+
+  if(alignment <= 8)
+    return kma_malloc(size);
+
+  if(size > SMALL_MAX)
+    return big_memalign(alignment, size);
+
+  if(!bins_ready)
+    init_bins();
+
+  segfit_bin* bin = &bins[size_class(size)];
+  int lowbit = bin->size & -bin->size;
+  int step = (lowbit < (int)alignment) ? (int)alignment / lowbit : 1;
+  int first = 0;
+
+  //runs are aligned to a page, the same objects of every run are aligned
+  while(first < step && first < bin->per_run && (RUN_HEADER + first * bin->size) % alignment != 0)
+    first++;
+
+  //no object of the class is aligned, it gets a page of its own
+  if(first == step || first >= bin->per_run)
+    return big_memalign(alignment, size);
+
+  segfit_run* run = bin->current;
+  int index = (run != NULL) ? aligned_object(bin, run, first, step) : -1;
+
+  if(index < 0){
+    for(run = bin->nonfull; run != NULL; run = run->next){
+      index = aligned_object(bin, run, first, step);
+      if(index >= 0)
+        break;
+    }
+
+    //the run it comes from becomes the current one, the old one goes on nonfull unless it is full
+    if(run != NULL){
+      unlink_run(bin, run);
+    }else{
+      run = new_run(bin);
+      index = first;
+    }
+
+    if(bin->current != NULL && bin->current->free_count > 0)
+      push_run(bin, bin->current);
+
+    bin->current = run;
+  }
+
+  return take_object(bin, run, index);
+}
+
+//an object that was never handed out from a run whose page came zeroed is still zero
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+  //nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+  //which together keep count * size from overflowing
+  if(count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    return NULL;
+
+  size *= count;
+
+  if(size > SMALL_MAX){
+    void* ptr = big_malloc(size);
+
+    if(ptr != NULL && !BIG_PAGE_OF(ptr)->zero)
+      memset(ptr, 0, size);
+
+    return ptr;
+  }
+
+  if(!bins_ready)
+    init_bins();
+
+  segfit_bin* bin = &bins[size_class(size)];
+  segfit_run* run = current_run(bin);
+  int index = lowest_free(run);
+  bool zero = (index >= run->fresh);
+  void* ptr = take_object(bin, run, index);
+
+  //the whole object is cleared. gcc turns a memset of a size it knows is small into rep stos,
+  //which is slow for small objects, and it doesn't know the bin's size
+  if(!zero)
+    memset(ptr, 0, bin->size);
+
+  return ptr;
+}
+
+#endif // KMA_SEGFIT
@@ -0,0 +1,737 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Kernel memory allocator with one size class per page and
+ *             sharded free lists (mimalloc)
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.2  2009/10/31 21:28:52  jot836
+ *    This is the current version of KMA project 3.
+ *    It includes:
+ *    - the most up-to-date handout (F'09)
+ *    - updated skeleton including
+ *        file-driven test harness,
+ *        trace generator script,
+ *        support for evaluating efficiency of algorithm (wasted memory),
+ *        gnuplot support for plotting allocation and waste,
+ *        set of traces for all students to use (including a makefile and README of the settings),
+ *    - different version of the testsuite for use on the submission site, including:
+ *        scoreboard Python scripts, which posts the top 5 scores on the course webpage
+ *
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ *    Revision 1.2  2004/11/05 15:45:56  sbirrer
+ *    - added size as a parameter to kma_free
+ *
+ *    Revision 1.1  2004/11/03 23:04:03  sbirrer
+ *    - initial version for the kernel memory allocator project
+ *
+ ***************************************************************************/
+#ifdef KMA_SHARD
+#define __KMA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+ //size classes are 16 byte steps up to 128, then 4 classes per power of 2 up to 896,
+ //then the largest sizes that fit 7, 6, 5, 4, 3 and 2 blocks in a page
+ #define QUANTUM 16
+ #define QUANTUM_MAX 128
+ #define QUARTER_MAX 896
+ #define QUARTER_CLASSES 19
+ #define NUM_CLASSES 25
+
+ //largest size class, requests above it get a page of their own. A multiple of a cache line
+ //(4048 would fit too), so that kma_memalign has a class for 64 byte aligned requests up to it
+ #define SMALL_MAX 4032
+
+ //the low 2 bits of a page's thread_free word tell a freeing thread what to do with the block
+ #define NO_DELAYED 0//push it on thread_free
+ #define USE_DELAYED 1//the page is on its owner's full list, give the block to the owner's heap instead
+ #define DELAYED_FREEING 2//a thread is doing that right now
+ #define NEVER_DELAYED 3//the page has no owner, always push on thread_free
+ #define STATE_MASK 3
+
+ #define TF_BLOCK(tf) ((shard_block*)((tf) & ~(uintptr_t)STATE_MASK))
+ #define TF_STATE(tf) ((int)((tf) & STATE_MASK))
+
+typedef struct shard_block shard_block;
+
+//a free block, the link is all it holds
+struct shard_block
+{
+  shard_block* next;
+};
+
+typedef struct shard_heap shard_heap;
+typedef struct shard_page shard_page;
+
+//header at the start of every page. The blocks of the page follow it
+struct shard_page
+{
+  kma_page_t* page;//the page object to hand back to free_page
+  shard_heap* heap;//heap of the owning thread, NULL while abandoned (read and written atomically)
+  shard_page* prev;//neighbours on the owner's page or full list, or on the abandoned list
+  shard_page* next;
+  shard_block* free;//blocks malloc pops from
+  shard_block* local_free;//blocks freed by the owner, become the free list once it runs out
+  uintptr_t thread_free;//blocks freed by other threads (compare and swap) | delayed free state
+  short used;//blocks handed out and not collected back yet
+  short class;
+  bool in_full;//on the owner's full list
+  bool zero;//the blocks on the free list hold only zeros but for their links (the page came
+            //zeroed and nothing was collected onto the list yet)
+};
+
+ #define CACHE_LINE 64
+
+ //offset of the first block of a page, a whole number of cache lines (the header is one)
+ //so that the blocks of a class are aligned to up to a cache line if its size is
+ #define PAGE_HEADER ((sizeof(shard_page) + CACHE_LINE - 1) & ~(CACHE_LINE - 1))
+
+ //a page of its own has its page object in the first word too, with the lowest bit set so
+ //kma_free_unsized can tell it from a page of blocks (page objects come from malloc)
+ #define BIG_PAGE_BIT 1L
+ #define IS_BIG_PAGE(ptr) (*(long*)BASEADDR(ptr) & BIG_PAGE_BIT)
+ #define BIG_PAGE_OF(ptr) ((kma_page_t*)(*(long*)BASEADDR(ptr) & ~BIG_PAGE_BIT))
+
+//the pages of one thread
+struct shard_heap
+{
+  shard_page* pages[NUM_CLASSES];//pages that may have free blocks, malloc uses the first one
+  shard_page* full[NUM_CLASSES];//pages found with no free block
+  shard_block* delayed;//blocks other threads freed into full pages (compare and swap)
+};
+
+/************Global Variables*********************************************/
+
+//block size of every class
+static const int kClassSize[NUM_CLASSES] = {
+	  16,   32,   48,   64,   80,   96,  112,  128,
+	 160,  192,  224,  256,  320,  384,  448,  512,
+	 640,  768,  896, 1152, 1344, 1616, 2016, 2688,
+	4032 };
+
+static __thread shard_heap gHeap;
+
+//true once this thread has asked to give up its pages when it exits
+static __thread bool gHeapRegistered = FALSE;
+
+static pthread_key_t gHeapKey;
+static pthread_once_t gHeapKeyOnce = PTHREAD_ONCE_INIT;
+
+//get_page and free_page are not thread safe
+static pthread_mutex_t gPageLock = PTHREAD_MUTEX_INITIALIZER;
+
+//pages of exited threads that still have blocks in use, one list per class
+static shard_page* gAbandoned[NUM_CLASSES];
+static pthread_mutex_t gAbandonedLock = PTHREAD_MUTEX_INITIALIZER;
+
+/************Function Prototypes******************************************/
+int size_class(kma_size_t size);
+kma_page_t* lock_get_page();
+void lock_free_page(kma_page_t* page);
+void push_page(shard_page** head, shard_page* page);
+void unlink_page(shard_page** head, shard_page* page);
+shard_page* new_page(int class);
+void set_delayed(shard_page* page, int state);
+void collect(shard_page* page);
+void local_free(shard_page* page, shard_block* block);
+void thread_free(shard_page* page, shard_block* block);
+void free_delayed();
+bool page_to_full(shard_page* page);
+shard_page* adopt_page(int class);
+shard_page* find_page(int class);
+void heap_abandon(void* unused);
+void heap_register();
+void* big_malloc(kma_size_t size);
+void* big_memalign(kma_size_t alignment, kma_size_t size);
+void free_block(void* ptr);
+void* class_malloc(int class);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+//size class of a request of at most SMALL_MAX bytes
+int size_class(kma_size_t size)
+{
+  if(size <= QUANTUM_MAX)
+    return (size <= 0) ? 0 : (size - 1) / QUANTUM;
+
+  if(size <= QUARTER_MAX){
+    //the top 3 bits of size - 1 pick the power of 2 and the quarter within it
+    int x = size - 1;
+    int log2 = 31 - __builtin_clz(x);
+
+    return QUANTUM_MAX / QUANTUM + (log2 - 7) * 4 + (x >> (log2 - 2)) - 4;
+  }
+
+  int class = QUARTER_CLASSES;
+  while(kClassSize[class] < size)
+    class++;
+
+  return class;
+}
+
+kma_page_t* lock_get_page()
+{
+  pthread_mutex_lock(&gPageLock);
+  kma_page_t* page = get_page();
+  pthread_mutex_unlock(&gPageLock);
+
+  return page;
+}
+
+void lock_free_page(kma_page_t* page)
+{
+  pthread_mutex_lock(&gPageLock);
+  free_page(page);
+  pthread_mutex_unlock(&gPageLock);
+}
+
+void push_page(shard_page** head, shard_page* page)
+{
+  page->prev = NULL;
+  page->next = *head;
+  if(*head != NULL)
+    (*head)->prev = page;
+  *head = page;
+}
+
+void unlink_page(shard_page** head, shard_page* page)
+{
+  if(page->prev != NULL)
+    page->prev->next = page->next;
+  else
+    *head = page->next;
+
+  if(page->next != NULL)
+    page->next->prev = page->prev;
+}
+
+//takes a new page for this thread and threads all of its blocks on the free list
+shard_page* new_page(int class)
+{
+  kma_page_t* kpage = lock_get_page();
+  shard_page* page = (shard_page*)kpage->ptr;
+  int size = kClassSize[class];
+  int capacity = (PAGESIZE - PAGE_HEADER) / size;
+  int i;
+
+  page->page = kpage;
+  page->heap = &gHeap;
+  page->local_free = NULL;
+  page->thread_free = NO_DELAYED;
+  page->used = 0;
+  page->class = class;
+  page->in_full = FALSE;
+  page->zero = kpage->zero;
+
+  //built backwards so blocks are handed out in address order
+  page->free = NULL;
+  for(i = capacity - 1; i >= 0; i--){
+    shard_block* block = (shard_block*)((char*)page + PAGE_HEADER + i * size);
+
+    block->next = page->free;
+    page->free = block;
+  }
+
+  push_page(&gHeap.pages[class], page);
+
+  return page;
+}
+
+//changes the delayed free state of a page, waiting for a thread that is in the
+//middle of a delayed free to finish with the page first
+void set_delayed(shard_page* page, int state)
+{
+  uintptr_t tf = __atomic_load_n(&page->thread_free, __ATOMIC_RELAXED);
+
+  for(;;){
+    if(TF_STATE(tf) == DELAYED_FREEING){
+      sched_yield();
+      tf = __atomic_load_n(&page->thread_free, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    uintptr_t tfx = (tf & ~(uintptr_t)STATE_MASK) | state;
+
+    if(__atomic_compare_exchange_n(&page->thread_free, &tf, tfx, TRUE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      return;
+  }
+}
+
+//moves the blocks freed since the free list ran out onto it (owner only)
+void collect(shard_page* page)
+{
+  if(page->free == NULL){
+    page->free = page->local_free;
+    page->local_free = NULL;
+    page->zero = FALSE;
+  }
+
+  //take the whole thread_free list, leaving the state bits alone
+  uintptr_t tf = __atomic_load_n(&page->thread_free, __ATOMIC_RELAXED);
+  while(TF_BLOCK(tf) != NULL
+        && !__atomic_compare_exchange_n(&page->thread_free, &tf, tf & STATE_MASK, TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    ;
+
+  shard_block* list = TF_BLOCK(tf);
+  if(list == NULL)
+    return;
+
+  shard_block* tail = list;
+  int count = 1;
+
+  while(tail->next != NULL){
+    tail = tail->next;
+    count++;
+  }
+
+  tail->next = page->free;
+  page->free = list;
+  page->used -= count;
+  page->zero = FALSE;
+}
+
+//a block freed by the thread that owns its page, no atomics needed
+void local_free(shard_page* page, shard_block* block)
+{
+  block->next = page->local_free;
+  page->local_free = block;
+  page->used--;
+
+  if(page->used == 0){
+    //nothing of the page is in use any more, give it back. No other thread holds one of its
+    //blocks, so none can be touching the page
+    unlink_page(page->in_full ? &gHeap.full[page->class] : &gHeap.pages[page->class], page);
+    lock_free_page(page->page);
+  }else if(page->in_full){
+    unlink_page(&gHeap.full[page->class], page);
+    push_page(&gHeap.pages[page->class], page);
+    page->in_full = FALSE;
+    set_delayed(page, NO_DELAYED);
+  }
+}
+
+//a block freed by another thread than the owner, never takes a lock
+void thread_free(shard_page* page, shard_block* block)
+{
+  uintptr_t tf = __atomic_load_n(&page->thread_free, __ATOMIC_RELAXED);
+  uintptr_t tfx;
+  bool use_delayed;
+
+  do{
+    use_delayed = (TF_STATE(tf) == USE_DELAYED);
+
+    if(use_delayed){
+      tfx = (tf & ~(uintptr_t)STATE_MASK) | DELAYED_FREEING;
+    }else{
+      block->next = TF_BLOCK(tf);
+      tfx = (uintptr_t)block | TF_STATE(tf);
+    }
+  }while(!__atomic_compare_exchange_n(&page->thread_free, &tf, tfx, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+  if(!use_delayed)
+    return;
+
+  //the page is on its owner's full list, which the owner doesn't look at. Hand the block to
+  //the owner's heap so it sees the page has room again. The owner waits for DELAYED_FREEING
+  //to clear before it gives up the page or the heap, so both stay valid until then
+  shard_heap* heap = __atomic_load_n(&page->heap, __ATOMIC_ACQUIRE);
+  shard_block* head = __atomic_load_n(&heap->delayed, __ATOMIC_RELAXED);
+
+  do{
+    block->next = head;
+  }while(!__atomic_compare_exchange_n(&heap->delayed, &head, block, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+  tf = __atomic_load_n(&page->thread_free, __ATOMIC_RELAXED);
+  do{
+    tfx = (tf & ~(uintptr_t)STATE_MASK) | NO_DELAYED;
+  }while(!__atomic_compare_exchange_n(&page->thread_free, &tf, tfx, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//frees the blocks other threads handed to this heap (owner only)
+void free_delayed()
+{
+  shard_block* block = __atomic_exchange_n(&gHeap.delayed, NULL, __ATOMIC_ACQUIRE);
+
+  while(block != NULL){
+    shard_block* next = block->next;
+    shard_page* page = (shard_page*)BASEADDR(block);
+
+    //the freeing thread may still be resetting the page's state. The page leaves the
+    //full list in local_free, so other threads can push on thread_free again
+    set_delayed(page, NO_DELAYED);
+
+    local_free(page, block);
+    block = next;
+  }
+}
+
+//moves a page with no free block to the full list, unless a block came back in the meantime.
+//Returns FALSE if the page has free blocks again
+bool page_to_full(shard_page* page)
+{
+  //from here on, other threads hand their frees to the heap instead
+  set_delayed(page, USE_DELAYED);
+
+  //a block freed before the state changed is on thread_free
+  collect(page);
+  if(page->free != NULL){
+    set_delayed(page, NO_DELAYED);
+    return FALSE;
+  }
+
+  unlink_page(&gHeap.pages[page->class], page);
+  push_page(&gHeap.full[page->class], page);
+  page->in_full = TRUE;
+
+  return TRUE;
+}
+
+//takes over a page of an exited thread, NULL if there is none
+shard_page* adopt_page(int class)
+{
+  pthread_mutex_lock(&gAbandonedLock);
+
+  shard_page* page = gAbandoned[class];
+  if(page != NULL){
+    unlink_page(&gAbandoned[class], page);
+    __atomic_store_n(&page->heap, &gHeap, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&gAbandonedLock);
+
+  if(page != NULL){
+    set_delayed(page, NO_DELAYED);
+    push_page(&gHeap.pages[class], page);
+  }
+
+  return page;
+}
+
+//the first page of the class ran out of free blocks: find another one with free blocks
+//and put it first. Pages found full are moved off the page list, so they aren't looked at again
+shard_page* find_page(int class)
+{
+  heap_register();
+  free_delayed();
+
+  shard_page* page = gHeap.pages[class];
+
+  while(page != NULL){
+    shard_page* next = page->next;
+
+    collect(page);
+
+    if(page->free != NULL || !page_to_full(page)){
+      if(page != gHeap.pages[class]){
+        unlink_page(&gHeap.pages[class], page);
+        push_page(&gHeap.pages[class], page);
+      }
+      return page;
+    }
+
+    page = next;
+  }
+
+  while((page = adopt_page(class)) != NULL){
+    collect(page);
+
+    if(page->free != NULL || !page_to_full(page))
+      return page;
+  }
+
+  return new_page(class);
+}
+
+//thread exit: the pages with blocks still in use go to the abandoned lists, the others are given back
+void heap_abandon(void* unused)
+{
+  int class;
+
+  //after this no other thread hands blocks to this heap any more
+  for(class = 0; class < NUM_CLASSES; class++){
+    shard_page* page;
+
+    for(page = gHeap.pages[class]; page != NULL; page = page->next)
+      set_delayed(page, NEVER_DELAYED);
+    for(page = gHeap.full[class]; page != NULL; page = page->next)
+      set_delayed(page, NEVER_DELAYED);
+  }
+
+  //every thread that handed a block to this heap is done with it now
+  shard_block* block;
+  for(block = __atomic_exchange_n(&gHeap.delayed, NULL, __ATOMIC_ACQUIRE); block != NULL; ){
+    shard_block* next = block->next;
+    shard_page* page = (shard_page*)BASEADDR(block);
+
+    local_free(page, block);
+    block = next;
+  }
+
+  for(class = 0; class < NUM_CLASSES; class++){
+    shard_page* lists[2] = { gHeap.pages[class], gHeap.full[class] };
+    int i;
+
+    gHeap.pages[class] = NULL;
+    gHeap.full[class] = NULL;
+
+    for(i = 0; i < 2; i++){
+      shard_page* page = lists[i];
+
+      while(page != NULL){
+        shard_page* next = page->next;
+
+        collect(page);
+
+        if(page->used == 0){
+          lock_free_page(page->page);
+        }else{
+          pthread_mutex_lock(&gAbandonedLock);
+          set_delayed(page, NEVER_DELAYED);
+          page->in_full = FALSE;
+          __atomic_store_n(&page->heap, NULL, __ATOMIC_RELEASE);
+          push_page(&gAbandoned[class], page);
+          pthread_mutex_unlock(&gAbandonedLock);
+        }
+
+        page = next;
+      }
+    }
+  }
+}
+
+void heap_make_key()
+{
+  pthread_key_create(&gHeapKey, heap_abandon);
+}
+
+//makes sure heap_abandon runs when this thread exits
+void heap_register()
+{
+  if(gHeapRegistered)
+    return;
+
+  pthread_once(&gHeapKeyOnce, heap_make_key);
+  pthread_setspecific(gHeapKey, &gHeap);
+  gHeapRegistered = TRUE;
+}
+
+//requests above SMALL_MAX get a page of their own, the page object goes in front
+void* big_malloc(kma_size_t size)
+{
+  if(size > PAGESIZE - (int)sizeof(kma_page_t*))
+    return NULL;
+
+  kma_page_t* page = lock_get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + sizeof(kma_page_t*);
+}
+
+//a page of its own with the payload at the alignment and the page object in front, for large
+//aligned requests and for small ones no block can be aligned for
+void* big_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(size > PAGESIZE - (int)alignment)
+    return NULL;
+
+  kma_page_t* page = lock_get_page();
+  *((long*)page->ptr) = (long)page | BIG_PAGE_BIT;
+
+  return (char*)page->ptr + alignment;
+}
+
+void* kma_malloc(kma_size_t size)
+{
+  if(size > SMALL_MAX)
+    return big_malloc(size);
+
+  return class_malloc(size_class(size));
+}
+
+void* class_malloc(int class)
+{
+  shard_page* page = gHeap.pages[class];
+
+  if(page == NULL || page->free == NULL)
+    page = find_page(class);
+
+  shard_block* block = page->free;
+
+  page->free = block->next;
+  page->used++;
+
+  return block;
+}
+
+//frees a block of a page of blocks, on whichever thread
+void free_block(void* ptr)
+{
+  shard_page* page = (shard_page*)BASEADDR(ptr);
+  shard_heap* heap = __atomic_load_n(&page->heap, __ATOMIC_ACQUIRE);
+
+  if(heap == &gHeap){
+    local_free(page, ptr);
+    return;
+  }
+
+  //a page nobody owns: take it over, the block is then freed locally. Holding the lock
+  //keeps anyone else from taking it first
+  if(heap == NULL){
+    pthread_mutex_lock(&gAbandonedLock);
+
+    if(__atomic_load_n(&page->heap, __ATOMIC_ACQUIRE) == NULL){
+      unlink_page(&gAbandoned[page->class], page);
+      __atomic_store_n(&page->heap, &gHeap, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&gAbandonedLock);
+
+      heap_register();
+      set_delayed(page, NO_DELAYED);
+      push_page(&gHeap.pages[page->class], page);
+      collect(page);
+      local_free(page, ptr);
+      return;
+    }
+
+    pthread_mutex_unlock(&gAbandonedLock);
+  }
+
+  thread_free(page, ptr);
+}
+
+//a small block of kma_memalign can have a page of its own too
+void kma_free(void* ptr, kma_size_t size)
+{
+  if(size > SMALL_MAX || IS_BIG_PAGE(ptr))
+    lock_free_page(BIG_PAGE_OF(ptr));
+  else
+    free_block(ptr);
+}
+
+//the page header has the class, a page of its own is told apart by the bit in its first word
+void kma_free_unsized(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    lock_free_page(BIG_PAGE_OF(ptr));
+  else
+    free_block(ptr);
+}
+
+//a page keeps its class until it is given back, which it isn't while a block of it is used
+kma_size_t kma_usable_size(void* ptr)
+{
+  if(IS_BIG_PAGE(ptr))
+    return PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr));
+
+  return kClassSize[((shard_page*)BASEADDR(ptr))->class];
+}
+
+//a block stays where it is if the new size is of the same class, otherwise it is copied
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  bool big = IS_BIG_PAGE(ptr);
+
+  //the payload of a page of its own starts further in if it was aligned
+  if(big && new_size > SMALL_MAX && new_size <= PAGESIZE - ((char*)ptr - (char*)BASEADDR(ptr)))
+    return ptr;
+
+  if(!big && new_size <= SMALL_MAX && size_class(old_size) == size_class(new_size))
+    return ptr;
+
+  void* new_ptr = kma_malloc(new_size);
+  if(new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+//an aligned block comes from the smallest class whose blocks are all aligned, kma_free finds
+//the class in the page header as it does for any block
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+
+  if(alignment <= 8)
+    return kma_malloc(size);
+
+  if(size > SMALL_MAX)
+    return big_memalign(alignment, size);
+
+  //no block is aligned to more than the first one of its page, and no class may be a
+  //multiple of the alignment. Such a block gets a page of its own
+  if(PAGE_HEADER % alignment != 0)
+    return big_memalign(alignment, size);
+
+  int class = size_class(size);
+  while(class < NUM_CLASSES && kClassSize[class] % alignment != 0)
+    class++;
+
+  if(class == NUM_CLASSES)
+    return big_memalign(alignment, size);
+
+  return class_malloc(class);
+}
+
+//a block from a page that came zeroed is still zero but for its link, as long as only blocks
+//that were never handed out are on the free list
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+  //nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+  //which together keep count * size from overflowing
+  if(count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    return NULL;
+
+  size *= count;
+
+  if(size > SMALL_MAX){
+    void* ptr = big_malloc(size);
+
+    if(ptr != NULL && !BIG_PAGE_OF(ptr)->zero)
+      memset(ptr, 0, size);
+
+    return ptr;
+  }
+
+  int class = size_class(size);
+  shard_block* block = class_malloc(class);
+
+  //only this thread changes the free list of its page. The whole block is cleared: gcc turns a
+  //memset of a size it knows is small into rep stos, which is slow for small blocks
+  if(((shard_page*)BASEADDR(block))->zero)
+    block->next = NULL;
+  else
+    memset(block, 0, kClassSize[class]);
+
+  return block;
+}
+
+#endif // KMA_SHARD
@@ -0,0 +1,281 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Kernel memory allocator based on slab object caches, one
+ *             per size class
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.2  2009/10/31 21:28:52  jot836
+ *    This is the current version of KMA project 3.
+ *    It includes:
+ *    - the most up-to-date handout (F'09)
+ *    - updated skeleton including
+ *        file-driven test harness,
+ *        trace generator script,
+ *        support for evaluating efficiency of algorithm (wasted memory),
+ *        gnuplot support for plotting allocation and waste,
+ *        set of traces for all students to use (including a makefile and README of the settings),
+ *    - different version of the testsuite for use on the submission site, including:
+ *        scoreboard Python scripts, which posts the top 5 scores on the course webpage
+ *
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ *    Revision 1.2  2004/11/05 15:45:56  sbirrer
+ *    - added size as a parameter to kma_free
+ *
+ *    Revision 1.1  2004/11/03 23:04:03  sbirrer
+ *    - initial version for the kernel memory allocator project
+ *
+ ***************************************************************************/
+#ifdef KMA_SLAB
+#define __KMA_IMPL__
+//name of this allocator's kma_ entry points when it is linked into the meta-allocator (KMA_META)
+#define KMA_BACKEND slab
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+#include "kma_cache.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+ //number of size classes
+ #define SIZE_CLASSES 26
+
+ //largest request served by a cache, larger ones get a page of their own
+ #define CACHE_MAX 4072
+
+ //objects of the default caches are aligned to their size's largest power of 2 up to this
+ //(a cache line, the step slabs are colored in)
+ #define CLASS_ALIGN_MAX 64
+
+ //number of alignments kma_memalign has caches of its own for (16 bytes up to a page)
+ #define ALIGN_ORDERS 10
+
+/************Global Variables*********************************************/
+
+//object size of each class. 16 byte steps up to 128, 4 classes per power of 2 up to 896,
+//then the largest sizes that fit 8, 7, 6, 5, 4, 3 and 2 objects in a slab
+static const int kClassSize[SIZE_CLASSES] = {
+	  16,   32,   48,   64,   80,   96,  112,  128,
+	 160,  192,  224,  256,  320,  384,  448,  512,
+	 640,  768,  896, 1016, 1160, 1352, 1624, 2032,
+	2712, 4072 };
+
+//size class of every request size up to CACHE_MAX, in 8 byte steps
+unsigned char class_of[CACHE_MAX / 8 + 1];
+
+//one cache per size class, created on first use
+kma_cache_t* caches[SIZE_CLASSES];
+
+//caches of size class objects aligned to 16 << i bytes, for the alignments the default ones don't give
+kma_cache_t* aligned_caches[SIZE_CLASSES][ALIGN_ORDERS];
+
+//number of objects handed out and not freed yet
+static int live_count = 0;
+
+bool classes_ready = FALSE;
+
+/************Function Prototypes******************************************/
+void init_classes();
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+//fills in the size class table
+void init_classes()
+{
+	int size, class = 0;
+
+	for(size = 0; size <= CACHE_MAX; size += 8){
+		while(kClassSize[class] < size)
+			class++;
+		class_of[size / 8] = class;
+	}
+
+	classes_ready = TRUE;
+}
+
+void* kma_malloc(kma_size_t size)
+{
+	//a page of its own, tagged in its last word
+	if(size > CACHE_MAX){
+		if(size > KMA_CACHE_PAGE_MAX)
+			return NULL;
+
+		return kma_cache_page_alloc();
+	}
+
+	if(!classes_ready)
+		init_classes();
+
+	int class = class_of[(size + 7) / 8];
+
+	if(caches[class] == NULL)
+		caches[class] = kma_cache_create(kClassSize[class], 0, NULL, NULL);
+
+	live_count++;
+
+	return kma_cache_alloc(caches[class]);
+}
+
+//the slab at the end of every page knows the cache, so the size isn't needed
+void kma_free(void* ptr, kma_size_t size)
+{
+	kma_free_unsized(ptr);
+}
+
+void kma_free_unsized(void* ptr)
+{
+	//the object may be from a larger or an aligned cache (kma_memalign), its slab knows
+	kma_cache_t* cache = kma_cache_of(ptr);
+
+	//a page of its own
+	if(cache == NULL){
+		free_page(kma_cache_page_of(ptr));
+		return;
+	}
+
+	kma_cache_free(cache, ptr);
+	live_count--;
+
+	//nothing is in use any more, give back the slabs the caches hold on to
+	if(live_count == 0){
+		int class, order;
+
+		for(class = 0; class < SIZE_CLASSES; class++){
+			if(caches[class] != NULL){
+				kma_cache_destroy(caches[class]);
+				caches[class] = NULL;
+			}
+			for(order = 0; order < ALIGN_ORDERS; order++){
+				if(aligned_caches[class][order] != NULL){
+					kma_cache_destroy(aligned_caches[class][order]);
+					aligned_caches[class][order] = NULL;
+				}
+			}
+		}
+	}
+}
+
+//an object is as large as the objects of its cache, a page of its own holds up to
+//KMA_CACHE_PAGE_MAX bytes
+kma_size_t kma_usable_size(void* ptr)
+{
+	kma_cache_t* cache = kma_cache_of(ptr);
+
+	if(cache == NULL)
+		return KMA_CACHE_PAGE_MAX;
+
+	return kma_cache_size(cache);
+}
+
+//an object stays where it is if the new size is of the same class, otherwise it is copied
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+	if(old_size > CACHE_MAX && new_size > CACHE_MAX && new_size <= KMA_CACHE_PAGE_MAX)
+		return ptr;
+
+	if(old_size <= CACHE_MAX && new_size <= CACHE_MAX && class_of[(old_size + 7) / 8] == class_of[(new_size + 7) / 8])
+		return ptr;
+
+	void* new_ptr = kma_malloc(new_size);
+	if(new_ptr == NULL)
+		return NULL;
+
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	kma_free(ptr, old_size);
+
+	return new_ptr;
+}
+
+//slabs are colored in cache line steps, so the objects of a default cache are aligned to the
+//largest power of 2 of their size up to a cache line. Other alignments get a cache of their
+//own, whose objects are spaced out to a multiple of the alignment
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+	if(alignment <= 0 || (alignment & (alignment - 1)) != 0 || alignment > PAGESIZE)
+		return NULL;
+
+	if(alignment <= 8)
+		return kma_malloc(size);
+
+	//a page of its own, its start is aligned to any alignment up to a page
+	if(size > CACHE_MAX){
+		if(size > KMA_CACHE_PAGE_MAX)
+			return NULL;
+
+		return kma_cache_page_alloc();
+	}
+
+	if(!classes_ready)
+		init_classes();
+
+	int class = class_of[(size + 7) / 8];
+	kma_cache_t** cache = &caches[class];
+
+	if(alignment > CLASS_ALIGN_MAX || kClassSize[class] % alignment != 0)
+		cache = &aligned_caches[class][__builtin_ctz(alignment) - 4];
+
+	if(*cache == NULL){
+		*cache = kma_cache_create(kClassSize[class], cache == &caches[class] ? 0 : alignment, NULL, NULL);
+
+		//the objects spaced out this far don't fit in a page
+		if(*cache == NULL)
+			return NULL;
+	}
+
+	live_count++;
+
+	return kma_cache_alloc(*cache);
+}
+
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+	//nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+	//which together keep count * size from overflowing
+	if(count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+		return NULL;
+
+	size *= count;
+
+	if(size > CACHE_MAX){
+		void* ptr = kma_malloc(size);
+
+		if(ptr != NULL && !kma_cache_page_of(ptr)->zero)
+			memset(ptr, 0, size);
+
+		return ptr;
+	}
+
+	if(!classes_ready)
+		init_classes();
+
+	int class = class_of[(size + 7) / 8];
+
+	if(caches[class] == NULL)
+		caches[class] = kma_cache_create(kClassSize[class], 0, NULL, NULL);
+
+	live_count++;
+
+	//objects of a slab that came zeroed are only cleared where their free list link was
+	return kma_cache_zalloc(caches[class]);
+}
+
+#endif // KMA_SLAB
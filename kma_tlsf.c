@@ -0,0 +1,506 @@
+/***************************************************************************
+ *  Title: Kernel Memory Allocator
+ * -------------------------------------------------------------------------
+ *    Purpose: Kernel memory allocator based on the two-level segregated
+ *             fit (TLSF) algorithm
+ *    Author: Stefan Birrer
+ *    Copyright: 2004 Northwestern University
+ ***************************************************************************/
+/***************************************************************************
+ *  ChangeLog:
+ * -------------------------------------------------------------------------
+ *    Revision 1.2  2009/10/31 21:28:52  jot836
+ *    This is the current version of KMA project 3.
+ *    It includes:
+ *    - the most up-to-date handout (F'09)
+ *    - updated skeleton including
+ *        file-driven test harness,
+ *        trace generator script,
+ *        support for evaluating efficiency of algorithm (wasted memory),
+ *        gnuplot support for plotting allocation and waste,
+ *        set of traces for all students to use (including a makefile and README of the settings),
+ *    - different version of the testsuite for use on the submission site, including:
+ *        scoreboard Python scripts, which posts the top 5 scores on the course webpage
+ *
+ *    Revision 1.1  2005/10/24 16:07:09  sbirrer
+ *    - skeleton
+ *
+ *    Revision 1.2  2004/11/05 15:45:56  sbirrer
+ *    - added size as a parameter to kma_free
+ *
+ *    Revision 1.1  2004/11/03 23:04:03  sbirrer
+ *    - initial version for the kernel memory allocator project
+ *
+ ***************************************************************************/
+#ifdef KMA_TLSF
+#define __KMA_IMPL__
+
+/************System include***********************************************/
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "kma_page.h"
+#include "kma.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+ //flags kept in the low bits of a block tag (block sizes are multiples of 8)
+ #define FREE_BIT 1
+ #define PREV_FREE_BIT 2
+ #define FLAG_BITS (FREE_BIT | PREV_FREE_BIT)
+
+ //every page starts with a pointer to its kma_page_t, the blocks follow it
+ #define PAGE_HEADER sizeof(kma_page_t*)
+
+ //smallest payload a block can have (a free block keeps its list links and its footer in the payload)
+ #define MIN_PAYLOAD 24
+
+ //smallest block worth splitting off a larger one
+ #define MIN_BLOCK ((int)sizeof(tlsf_block) + MIN_PAYLOAD)
+
+ //largest payload of a block, a whole page less the page header and one tag
+ #define MAX_PAYLOAD (PAGESIZE - (int)PAGE_HEADER - (int)sizeof(tlsf_block))
+
+ //each first level range is split into 2^SL_LOG2 second level lists
+ #define SL_LOG2 4
+ #define SL_COUNT (1 << SL_LOG2)
+
+ //payloads below SMALL_BLOCK all go to first level 0, split linearly in 8 byte steps
+ #define SMALL_LOG2 (SL_LOG2 + 3)
+ #define SMALL_BLOCK (1 << SMALL_LOG2)
+
+ //first level 0 for payloads below 128, then one per power of 2 from 128 up to 4096..8191
+ #define FL_COUNT 7
+
+typedef struct tlsf_block tlsf_block;
+
+//tag at the start of every block. A free block repeats its size as a footer in its
+//last 8 bytes, so the block after it can find it
+struct tlsf_block
+{
+  size_t tag;//size of the whole block (this tag included) | FREE_BIT | PREV_FREE_BIT
+};
+
+typedef struct tlsf_links tlsf_links;
+
+//lives in the payload of every free block
+struct tlsf_links
+{
+  tlsf_block* prev_free;//the previous block in the same list
+  tlsf_block* next_free;//the next block in the same list
+};
+
+/************Global Variables*********************************************/
+
+//bit fl is set when some list of first level fl is not empty
+unsigned int fl_bitmap = 0;
+
+//bit sl of entry fl is set when list [fl][sl] is not empty
+unsigned int sl_bitmap[FL_COUNT];
+
+//heads of the free lists
+tlsf_block* free_heads[FL_COUNT][SL_COUNT];
+
+/************Function Prototypes******************************************/
+void mapping(int size, int* fl, int* sl);
+void insert_block(tlsf_block* block);
+void remove_block(tlsf_block* block);
+tlsf_block* find_block(int size);
+tlsf_block* new_page_block();
+void* take_block(tlsf_block* block, int size);
+char* aligned_payload(tlsf_block* block, int align);
+void* big_malloc(kma_size_t size);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+int block_size(tlsf_block* block)
+{
+  return block->tag & ~FLAG_BITS;
+}
+
+//payload size of a block
+int payload_size(tlsf_block* block)
+{
+  return block_size(block) - sizeof(tlsf_block);
+}
+
+void* data_ptr(tlsf_block* block)
+{
+  return block + 1;//add sizeof(tlsf_block)
+}
+
+tlsf_links* links(tlsf_block* block)
+{
+  return (tlsf_links*)data_ptr(block);
+}
+
+//true when the block runs to the end of its page
+bool last_in_page(tlsf_block* block)
+{
+  return (char*)block + block_size(block) == (char*)BASEADDR(block) + PAGESIZE;
+}
+
+//the block right after this one, only valid if it isn't the last one in its page
+tlsf_block* next_block(tlsf_block* block)
+{
+  return (tlsf_block*)((char*)block + block_size(block));
+}
+
+//the block right before this one, only valid if PREV_FREE_BIT is set (it has a footer)
+tlsf_block* prev_block(tlsf_block* block)
+{
+  size_t prev_size = *((size_t*)block - 1);
+
+  return (tlsf_block*)((char*)block - prev_size);
+}
+
+//marks a block free and writes its footer
+void set_free(tlsf_block* block, int size)
+{
+  block->tag = size | FREE_BIT | (block->tag & PREV_FREE_BIT);
+
+  *((size_t*)((char*)block + size) - 1) = size;
+}
+
+//first and second level list of a payload size
+void mapping(int size, int* fl, int* sl)
+{
+  if(size < SMALL_BLOCK){
+    *fl = 0;
+    *sl = size / (SMALL_BLOCK / SL_COUNT);
+  }else{
+    int log2 = 31 - __builtin_clz(size);
+    *fl = log2 - SMALL_LOG2 + 1;
+    *sl = (size >> (log2 - SL_LOG2)) - SL_COUNT;
+  }
+}
+
+//pushes a free block on the front of the list for its size
+void insert_block(tlsf_block* block)
+{
+  int fl, sl;
+  mapping(payload_size(block), &fl, &sl);
+
+  links(block)->prev_free = NULL;
+  links(block)->next_free = free_heads[fl][sl];
+
+  if(free_heads[fl][sl] != NULL)
+    links(free_heads[fl][sl])->prev_free = block;
+
+  free_heads[fl][sl] = block;
+
+  fl_bitmap |= 1 << fl;
+  sl_bitmap[fl] |= 1 << sl;
+}
+
+//unlinks a free block from its list, must be called before its size changes
+void remove_block(tlsf_block* block)
+{
+  int fl, sl;
+  mapping(payload_size(block), &fl, &sl);
+
+  tlsf_links* block_links = links(block);
+
+  if(block_links->prev_free != NULL)
+    links(block_links->prev_free)->next_free = block_links->next_free;
+  else
+    free_heads[fl][sl] = block_links->next_free;
+
+  if(block_links->next_free != NULL)
+    links(block_links->next_free)->prev_free = block_links->prev_free;
+
+  //the list went empty
+  if(free_heads[fl][sl] == NULL){
+    sl_bitmap[fl] &= ~(1 << sl);
+    if(sl_bitmap[fl] == 0)
+      fl_bitmap &= ~(1 << fl);
+  }
+}
+
+//returns a free block of at least size bytes of payload in constant time, or NULL if there is none.
+//The size is rounded up to the next list so that any block of the list found fits
+tlsf_block* find_block(int size)
+{
+  int fl, sl;
+
+  if(size >= SMALL_BLOCK)
+    size += (1 << (31 - __builtin_clz(size) - SL_LOG2)) - 1;
+
+  mapping(size, &fl, &sl);
+
+  if(fl >= FL_COUNT)
+    return NULL;
+
+  //lists of the same first level holding larger blocks
+  unsigned int sl_map = sl_bitmap[fl] & (~0U << sl);
+
+  if(sl_map == 0){
+    //otherwise the smallest non empty list of a larger first level
+    unsigned int fl_map = (fl + 1 < 32) ? fl_bitmap & (~0U << (fl + 1)) : 0;
+
+    if(fl_map == 0)
+      return NULL;
+
+    fl = __builtin_ctz(fl_map);
+    sl_map = sl_bitmap[fl];
+  }
+
+  sl = __builtin_ctz(sl_map);
+
+  return free_heads[fl][sl];
+}
+
+//takes a new page and returns its single (free) block, not on any list yet
+tlsf_block* new_page_block()
+{
+  kma_page_t* page = get_page();
+
+  *((kma_page_t**)page->ptr) = page;
+
+  //nothing comes before the first block, so its PREV_FREE_BIT stays clear
+  tlsf_block* block = (tlsf_block*)((char*)page->ptr + PAGE_HEADER);
+  block->tag = 0;
+  set_free(block, PAGESIZE - PAGE_HEADER);
+
+  return block;
+}
+
+//requests too big for a block get a page of their own, right after the page header. No block
+//payload starts there, which is how kma_free tells them apart
+void* big_malloc(kma_size_t size)
+{
+  if(size > PAGESIZE - (int)PAGE_HEADER)
+    return NULL;
+
+  kma_page_t* page = get_page();
+
+  *((kma_page_t**)page->ptr) = page;
+
+  return (char*)page->ptr + PAGE_HEADER;
+}
+
+void* kma_malloc(kma_size_t size)
+{
+  if(size > MAX_PAYLOAD)
+    return big_malloc(size);
+
+  //every block must be able to hold the list links and the footer once it
+  //is freed, and payloads are kept 8 byte aligned
+  size = (size < MIN_PAYLOAD) ? MIN_PAYLOAD : (size + 7) & ~7;
+
+  tlsf_block* block = find_block(size);
+
+  if(block != NULL)
+    remove_block(block);
+  else
+    block = new_page_block();
+
+  return take_block(block, size);
+}
+
+//hands out a free block that is on no list, the rest after size bytes of payload is
+//split off if it is large enough to be a block
+void* take_block(tlsf_block* block, int size)
+{
+  int needed = size + sizeof(tlsf_block);
+  int rest = block_size(block) - needed;
+
+  if(rest >= MIN_BLOCK){
+    //split the rest off as a free block of its own
+    block->tag = needed | (block->tag & PREV_FREE_BIT);
+
+    tlsf_block* rest_block = next_block(block);
+    rest_block->tag = 0;
+    set_free(rest_block, rest);
+    insert_block(rest_block);
+  }else{
+    block->tag &= ~FREE_BIT;
+
+    if(!last_in_page(block))
+      __atomic_fetch_and(&next_block(block)->tag, ~PREV_FREE_BIT, __ATOMIC_RELAXED);
+  }
+
+  return data_ptr(block);
+}
+
+void kma_free(void* ptr, kma_size_t size)
+{
+  //a page of its own
+  if((char*)ptr == (char*)BASEADDR(ptr) + PAGE_HEADER){
+    free_page(*((kma_page_t**)BASEADDR(ptr)));
+    return;
+  }
+
+  tlsf_block* block = (tlsf_block*)ptr - 1;
+  int new_size = block_size(block);
+
+  //blocks never span pages, so there is nothing to merge past the end of the page
+  if(!last_in_page(block) && (next_block(block)->tag & FREE_BIT)){
+    tlsf_block* next = next_block(block);
+
+    remove_block(next);
+    new_size += block_size(next);
+  }
+
+  if(block->tag & PREV_FREE_BIT){
+    tlsf_block* prev = prev_block(block);
+
+    remove_block(prev);
+    new_size += block_size(prev);
+    block = prev;
+  }
+
+  //the whole page is free, give it back
+  if(new_size == PAGESIZE - PAGE_HEADER){
+    free_page(*((kma_page_t**)BASEADDR(block)));
+    return;
+  }
+
+  set_free(block, new_size);
+
+  if(!last_in_page(block))
+    __atomic_fetch_or(&next_block(block)->tag, PREV_FREE_BIT, __ATOMIC_RELAXED);
+
+  insert_block(block);
+}
+
+//the size never was needed, a block's tag has it and a page of its own has its payload right
+//after the page object
+void kma_free_unsized(void* ptr)
+{
+  kma_free(ptr, 0);
+}
+
+//the size bits of a used block's tag don't change, but its neighbours set and clear
+//PREV_FREE_BIT in the same word, so the tag is read atomically
+kma_size_t kma_usable_size(void* ptr)
+{
+  if((char*)ptr == (char*)BASEADDR(ptr) + PAGE_HEADER)
+    return PAGESIZE - PAGE_HEADER;
+
+  tlsf_block* block = (tlsf_block*)ptr - 1;
+
+  return (__atomic_load_n(&block->tag, __ATOMIC_RELAXED) & ~FLAG_BITS) - sizeof(tlsf_block);
+}
+
+//the block stays if malloc would have handed out the same block for the new size (it fits
+//and the rest is too small to split off), otherwise it is copied
+void* kma_realloc(void* ptr, kma_size_t old_size, kma_size_t new_size)
+{
+  bool big = (char*)ptr == (char*)BASEADDR(ptr) + PAGE_HEADER;
+
+  if(big && new_size > MAX_PAYLOAD && new_size <= PAGESIZE - (int)PAGE_HEADER)
+    return ptr;
+
+  if(!big && new_size <= MAX_PAYLOAD){
+    tlsf_block* block = (tlsf_block*)ptr - 1;
+    int size = (new_size < MIN_PAYLOAD) ? MIN_PAYLOAD : (new_size + 7) & ~7;
+    int rest = block_size(block) - (size + (int)sizeof(tlsf_block));
+
+    if(rest >= 0 && rest < MIN_BLOCK)
+      return ptr;
+  }
+
+  void* new_ptr = kma_malloc(new_size);
+  if(new_ptr == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  kma_free(ptr, old_size);
+
+  return new_ptr;
+}
+
+//where the aligned payload starts in a free block: at the block's own payload if that is aligned,
+//otherwise far enough in for what comes before to be a free block of its own
+char* aligned_payload(tlsf_block* block, int align)
+{
+  char* payload = data_ptr(block);
+  char* aligned = (char*)(((unsigned long)payload + align - 1) & ~(unsigned long)(align - 1));
+
+  while(aligned != payload && aligned - payload < MIN_BLOCK)
+    aligned += align;
+
+  return aligned;
+}
+
+//the block is cut in two where the aligned payload can start with a free block in front of it
+void* kma_memalign(kma_size_t alignment, kma_size_t size)
+{
+  if(alignment <= 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+
+  if(alignment <= 8)
+    return kma_malloc(size);
+
+  //a page of its own only has room once the payload is past the page header
+  if(size > MAX_PAYLOAD)
+    return NULL;
+
+  size = (size < MIN_PAYLOAD) ? MIN_PAYLOAD : (size + 7) & ~7;
+
+  //the block malloc would pick may have room for the aligned payload, every free block of the
+  //padded size has room for it and a free block in front of it
+  tlsf_block* block = find_block(size);
+
+  if(block == NULL || aligned_payload(block, alignment) + size > (char*)block + block_size(block))
+    block = find_block(size + alignment + MIN_BLOCK);
+
+  if(block != NULL)
+    remove_block(block);
+  else
+    block = new_page_block();
+
+  char* payload = data_ptr(block);
+  char* aligned = aligned_payload(block, alignment);
+
+  //only a new page can be too small, the alignment puts the payload too close to its end
+  if(aligned + size > (char*)block + block_size(block)){
+    free_page(*((kma_page_t**)BASEADDR(block)));
+    return NULL;
+  }
+
+  if(aligned != payload){
+    tlsf_block* aligned_block = (tlsf_block*)aligned - 1;
+    int gap = (char*)aligned_block - (char*)block;
+
+    aligned_block->tag = (block_size(block) - gap) | PREV_FREE_BIT;
+
+    set_free(block, gap);
+    insert_block(block);
+
+    block = aligned_block;
+  }
+
+  return take_block(block, size);
+}
+
+//blocks keep their tags and free list links in the memory around and inside them, so only a
+//page of its own can be known to be zero
+void* kma_calloc(kma_size_t count, kma_size_t size)
+{
+  //nothing is zeroed for a count or size below 1, and no request fits in more than a page,
+  //which together keep count * size from overflowing
+  if(count <= 0 || size <= 0 || (long)count * size > PAGESIZE)
+    return NULL;
+
+  size *= count;
+
+  void* ptr = kma_malloc(size);
+
+  if(ptr != NULL && (size <= MAX_PAYLOAD || !(*((kma_page_t**)BASEADDR(ptr)))->zero))
+    memset(ptr, 0, size);
+
+  return ptr;
+}
+
+#endif // KMA_TLSF